@@ -14,23 +14,47 @@
 #include "types.hpp"
 #include "service.hpp"
 #include "service_database_class.hpp"
+#include "shm_channel_class.hpp"
 
 #define ROUTER_POLL_INDEX 0
 #define REG_POLL_INDEX 1
 #define HC_POLL_INDEX 2
-#define DEALER_POLL_INDEX 3
+#define BACKEND_POLL_INDEX 3
+
+/* Inproc endpoints between the front end and the shards */
+#define SHARD_FRONT_ENDPOINT "shard-front-"
+#define SHARD_REG_ENDPOINT "shard-reg-"
+#define SHARD_HC_ENDPOINT "shard-hc-"
+
+/* Copy of a shm endpoint that is the handover listener of its service */
+#define SHM_LISTENER -1
+
+/**
+ * @class shm_endpoint_t
+ * @brief Descriptor polled for the shared memory transport, either the
+ * 	  listener of the handovers of a service or the channel of a copy
+ */
+
+struct shm_endpoint_t {
+	service_type_t service;
+	/* Copy of the channel, SHM_LISTENER for the listener */
+	int8_t copy;
+	int32_t fd;
+};
 
 /**
  * @class RSF_Broker
  * @file broker_class.hpp
- * @brief 
+ * @brief Broker that serves a set of services. It is either the whole 
+ * 	  broker, or a shard of RSF_ShardedBroker that receives the client
+ * 	  requests and the registrations from the front end over inproc 
+ * 	  sockets. It is specialized on the redundancy of the voter.
  */
  
+template<uint8_t nmr>
 class RSF_Broker {
 
 private:
-	/* Redundancy for the voter */
-	uint8_t nmr;
 	/* Ports for communication */
 	std::list<uint16_t> port_dealer; 
 	uint16_t port_router;
@@ -38,34 +62,71 @@ private:
 	uint16_t available_dealer_port;
 	/* Poll set */
 	std::vector<zmq::pollitem_t> items;
+	/* Index of the first backend socket in the poll set */
+	uint32_t backend_poll_index;
 	/* Sockets for ZMQ communication */
 	zmq::context_t *context;
-	std::vector<zmq::socket_t*> dealer;
+	/* False if the context is shared with the front end */
+	bool own_context;
+	/* Backend ROUTER sockets, one for each service, addressing the 
+	 * server copies by identity */
+	std::vector<zmq::socket_t*> backend;
+	/* Descriptors of the shared memory transport, polled after the 
+	 * backend sockets */
+	std::vector<shm_endpoint_t> shm_endpoints;
 	zmq::socket_t *reg;
 	zmq::socket_t *router;
 	zmq::socket_t *hc;
 	/* Services Database */
-	ServiceDatabase *db;
+	ServiceDatabase<nmr> *db;
 	/* Vector of available services */
 	std::vector<service_type_t> available_services;
 	/* Vectors of times for heartbeating */
 	std::vector<struct timespec> timeout;
+	/* Earliest heartbeat timeout, it may be earlier than the real one 
+	 * if a timeout has been postponed in the meanwhile */
+	struct timespec hb_deadline;
 	struct timespec now;
+	/* Buffer for the requests whose timeout is expired */
+	std::vector<request_record_t> expired_requests;
 	/* Identificator used for logging */
 	std::string my_name;
 	
-	/* Function for voting */
-	int8_t vote(std::vector<int32_t> values, int32_t &result);
+	/* Function for answering the client with the voted results */
+	void reply_client(std::vector<zmq::message_t> &buffer, 
+		request_record_t *request);
+	/* Function for sending a duplex request to the copies held back */
+	void escalate_request(service_record<nmr> *record, uint32_t slot);
+	/* Function for answering the client with cached results */
+	void reply_cached(std::vector<zmq::message_t> &buffer, 
+		uint32_t request_id, const std::vector<int32_t> *results);
 	/* Function for sending a ping to a group of servers */
-	void ping_server(uint8_t i, service_type_t service);
-	/* Function for adding a dealer socket */
-	void add_dealer(uint16_t dealer_port);
+	void ping_server(service_type_t service);
+	/* Function for adding a backend socket */
+	void add_backend(uint16_t dealer_port, service_record<nmr> *record);
+	/* Function for polling a descriptor of the shared memory transport */
+	void add_shm_endpoint(service_type_t service, int8_t copy, int32_t fd);
+	/* Function for attaching the channel handed over by a copy */
+	void attach_channel(const shm_endpoint_t &listener);
+	/* Function for releasing the channel of a copy */
+	void detach_channel(service_record<nmr> *record, uint8_t copy);
+	/* Function to get a message from a shared memory descriptor */
+	void get_shm_message(uint32_t index);
+	/* Function for sending a message to a set of server copies */
+	void send_to_copies(service_record<nmr> *record, uint32_t copies,
+		std::vector<zmq::message_t> &buffer);
+	/* Function for cancelling a request on the copies that have not 
+	 * answered */
+	void cancel_copies(service_record<nmr> *record, 
+		request_record_t *request);
 	/* Function to get a request from the client */
 	void get_request();
 	/* Function to get a registration from the server */
 	void get_registration();
 	/* Function to get a service response from a server */
-	void get_response(uint32_t dealer_index);
+	void get_response(uint32_t backend_index);
+	/* Function to handle the reply or the pong of a server */
+	void handle_reply(std::vector<zmq::message_t> &buffer_in);
 	/* Function for printing the available services */
 	void print_available_services();
 	/* Function for sending a pong to the health checker */
@@ -74,8 +135,20 @@ private:
 	void update_timeout(service_type_t service);
 	/* Check if the timeout is elapsed for the pending requests */
 	void check_pending_requests();
+	/* Computes the poll timeout until the next timer deadline */
+	int64_t next_timer_expiry();
+	/* Fires the heartbeat and request timers that are due */
+	void fire_timers();
 public:
-	RSF_Broker(uint8_t nmr, uint16_t port_router, uint16_t port_reg);
+	RSF_Broker(uint16_t port_router, uint16_t port_reg);
+	RSF_Broker(zmq::context_t *context, uint16_t shard, 
+		uint16_t dealer_port);
+	void enable_cache(service_type_t service, uint32_t size, 
+		uint32_t ttl_ms);
+	void enable_coalescing(service_type_t service);
+	void enable_affinity(service_type_t service);
+	void enable_duplex(service_type_t service);
+	void set_transport(service_type_t service, uint8_t transport);
 	void step();
 	~RSF_Broker();
 };
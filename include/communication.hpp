@@ -8,10 +8,13 @@
 
 #include <arpa/inet.h>
 #include <string>
+#include <tuple>
+#include <string.h>
 #include "service.hpp"
 
 #define TCP_PROTOCOL "tcp://"
 #define IPC_PROTOCOL "ipc://"
+#define INPROC_PROTOCOL "inproc://"
 #define LOCALHOST "localhost"
 #define ANY_ADDRESS "*"
 #define BIND 0
@@ -19,11 +22,19 @@
 #define MAX_LENGTH_STRING_PORT 6
 #define EMPTY_MSG (void*)""
 
+/* Transports between the broker and the copies of a service. With 
+ * TRANSPORT_IPC and TRANSPORT_SHM the copies are on the host of the 
+ * broker, with TRANSPORT_SHM the requests and the replies go through a
+ * ShmChannel and the ipc socket is used until the channel is attached */
+#define TRANSPORT_TCP 0
+#define TRANSPORT_IPC 1
+#define TRANSPORT_SHM 2
+#define IPC_PATH_PREFIX "/tmp/rsf_"
+
 #define NUM_FRAMES 3
 #define ID_FRAME 0
 #define EMPTY_FRAME 1
 #define DATA_FRAME 2
-#define LENGTH_ID_FRAME 5
 #define ENVELOPE 3
 
 #define HEARTBEAT_INTERVAL 2000
@@ -35,16 +46,72 @@
 #define NO_PONG -1
 
 #define MAX_NMR 5
+/* Max number of copies of a service, spares and groups included. The 
+ * copies are kept in 32 bit masks */
+#define MAX_REPLICAS 16
+/* Max number of groups of copies of a service, a request is voted within
+ * a group */
+#define MAX_GROUPS 4
+
+/* Types of the service module */
+#define SM_REQUEST 0
+#define SM_PING 1
+#define SM_CANCEL 2
+
+/* Version of the wire protocol, carried by every module. A message of a 
+ * different version is dropped. */
+#define WIRE_VERSION 1
+/* Types of the fields of an operation */
+#define WIRE_INT32 1
+#define WIRE_UINT32 2
+#define WIRE_INT64 3
+#define WIRE_UINT64 4
+#define WIRE_FLOAT32 5
+#define WIRE_FLOAT64 6
+/* An operation is prefixed by its length, a field by its type and length */
+#define OP_HEADER_SIZE 2
+#define FIELD_HEADER_SIZE 3
+/* Max length of the fields of an operation */
+#define MAX_OP_SIZE 0xFFFF
+/* Max number of operations in a batch */
+#define MAX_BATCH_OPS 1024
+/* Payloads are split in frames of at most this size */
+#define PAYLOAD_CHUNK_SIZE (64 * 1024)
+/* Length of the digest of a payload */
+#define DIGEST_SIZE 16
 
-#define PARAM_SIZE 100
+/* 
+ * The data frame of every message is made of one of the following modules
+ * followed by num_ops elements, one for each operation of the batch: an 
+ * operation for the requests and an int32_t result for the replies. A 
+ * single request is a batch of one operation. 
+ *
+ * The modules have an explicit layout without padding, so the results 
+ * that follow them are aligned and can be read in place. An operation is
+ * a uint16_t length followed by its fields, a field is a uint8_t type, a 
+ * uint16_t length and the value. Every integer is in network byte order.
+ *
+ * A request of a single operation and a reply can be followed by a payload,
+ * carried in the frames after the data frame in chunks of at most 
+ * PAYLOAD_CHUNK_SIZE bytes. The broker forwards the payload frames by 
+ * reference. The reply of a service that returns a payload carries the 
+ * DIGEST_SIZE bytes digest of the payload after its result, which is the
+ * length of the payload: the broker votes on the digests.
+ */
 
 /**
  * @brief      client request module for the service
  */
  
 struct request_module {
-	service_type_t service;
-	char_t parameters[PARAM_SIZE];
+	uint8_t version;
+	uint8_t reserved[3];
+	/* Requested service */
+	uint32_t service;
+	/* Identifier chosen by the client, echoed in the response */
+	uint32_t request_id;
+	/* Number of operations that follow the module */
+	uint32_t num_ops;
 };
 
 /**
@@ -52,7 +119,8 @@ struct request_module {
  */
  
 enum service_status_t {
-	SERVICE_AVAILABLE, SERVICE_NOT_AVAILABLE, SERVICE_NOT_RELIABLE
+	SERVICE_AVAILABLE, SERVICE_NOT_AVAILABLE, SERVICE_NOT_RELIABLE,
+	SERVICE_MALFORMED
 };
 
 /**
@@ -60,8 +128,14 @@ enum service_status_t {
  */
  
 struct response_module {
-	service_status_t service_status;
-	int32_t result;
+	uint8_t version;
+	uint8_t reserved[3];
+	/* Status of the service */
+	uint32_t service_status;
+	/* Identifier of the client request */
+	uint32_t request_id;
+	/* Number of results that follow the module */
+	uint32_t num_ops;
 };
 
 /*
@@ -69,11 +143,14 @@ struct response_module {
  */
  
 struct service_module {
-	/* If true it is a ping, otherwise it's a service 
-	 * request */
-	bool heartbeat;
+	uint8_t version;
+	/* Either a service request, a ping or the cancellation of a 
+	 * request whose result is no longer needed */
+	uint8_t type;
+	uint16_t reserved;
 	uint32_t seq_id;
-	char_t parameters[PARAM_SIZE];
+	/* Number of operations that follow the module */
+	uint32_t num_ops;
 };
 
 /**
@@ -83,39 +160,359 @@ struct service_module {
  */
  
 struct server_reply_t {
-	bool heartbeat;
-	bool duplicated;
-	int32_t result;
-	service_type_t service;
+	uint8_t version;
+	uint8_t heartbeat;
+	uint8_t duplicated;
 	uint8_t id; 
+	/* Service of the server */
+	uint32_t service;
+	/* Seq. number of the request the reply refers to */
+	uint32_t seq_id;
+	/* Number of results that follow the module */
+	uint32_t num_ops;
 };
 
 /**
- * @brief Function used to serialize the parameters in a string
- * @param str String used to store the serialized parameters
+ * @brief      digest of a payload, it follows the result of a reply
  */
 
-inline void serialize(std::string &str) {}
+struct digest_t {
+	uint8_t bytes[DIGEST_SIZE];
+};
+
+static_assert(sizeof(request_module) == 16, "request_module is padded");
+static_assert(sizeof(response_module) == 16, "response_module is padded");
+static_assert(sizeof(service_module) == 12, "service_module is padded");
+static_assert(sizeof(server_reply_t) == 16, "server_reply_t is padded");
+
+/**
+ * @brief Initializes a response module, the values are in host byte order
+ * @param rm Module to be initialized
+ * @param status Status of the service
+ * @param request_id Identifier of the client request
+ * @param num_ops Number of results that follow the module
+ */
+
+inline void init_response_module(response_module *rm, 
+	service_status_t status, uint32_t request_id, uint32_t num_ops)
+{
+	rm->version = WIRE_VERSION;
+	memset(rm->reserved, 0, sizeof(rm->reserved));
+	rm->service_status = htonl((uint32_t) status);
+	rm->request_id = htonl(request_id);
+	rm->num_ops = htonl(num_ops);
+}
+
+/**
+ * @brief Initializes a service module, the values are in host byte order
+ * @param sm Module to be initialized
+ * @param type Type of the message
+ * @param seq_id Seq. number of the request or of the ping
+ * @param num_ops Number of operations that follow the module
+ */
+
+inline void init_service_module(service_module *sm, uint8_t type, 
+	uint32_t seq_id, uint32_t num_ops)
+{
+	sm->version = WIRE_VERSION;
+	sm->type = type;
+	sm->reserved = 0;
+	sm->seq_id = htonl(seq_id);
+	sm->num_ops = htonl(num_ops);
+}
+
+/**
+ * @brief Initializes a server reply, the values are in host byte order
+ * @param sr Reply to be initialized
+ * @param id Identifier of the server copy
+ * @param service Service of the server
+ * @param seq_id Seq. number of the request
+ * @param num_ops Number of results that follow the reply
+ */
+
+inline void init_server_reply(server_reply_t *sr, uint8_t id, 
+	service_type_t service, uint32_t seq_id, uint32_t num_ops)
+{
+	sr->version = WIRE_VERSION;
+	sr->heartbeat = false;
+	sr->duplicated = false;
+	sr->id = id;
+	sr->service = htonl((uint32_t) service);
+	sr->seq_id = htonl(seq_id);
+	sr->num_ops = htonl(num_ops);
+}
+
+/**
+ * @brief Gets the operations that follow a module
+ * @param data Data frame starting with the module
+ * @return It returns the pointer to the first operation
+ */
+
+template<typename module_t>
+inline uint8_t *module_params(void *data)
+{
+	return static_cast<uint8_t*>(data) + sizeof(module_t);
+}
+
+/**
+ * @brief Gets the results that follow a module
+ * @param data Data frame starting with the module
+ * @return It returns the pointer to the first result
+ */
+
+template<typename module_t>
+inline int32_t *module_results(void *data)
+{
+	return reinterpret_cast<int32_t*>(static_cast<char_t*>(data) + 
+		sizeof(module_t));
+}
+
+/**
+ * @brief Reads an unaligned uint16_t in network byte order
+ */
+
+inline uint16_t wire_get16(const uint8_t *p)
+{
+	return (uint16_t) ((p[0] << 8) | p[1]);
+}
+
+/**
+ * @brief Writes an unaligned uint16_t in network byte order
+ */
+
+inline void wire_put16(uint8_t *p, uint16_t value)
+{
+	p[0] = value >> 8;
+	p[1] = value & 0xFF;
+}
+
+/**
+ * @brief Reads an unaligned value of 4 or 8 bytes in network byte order
+ */
+
+template<typename T>
+inline T wire_get(const uint8_t *p)
+{
+	uint64_t bits = 0;
+	T value;
+
+	for (uint8_t i = 0; i < sizeof(T); i++)
+		bits = (bits << 8) | p[i];
+	if (sizeof(T) == sizeof(uint32_t)) {
+		uint32_t bits32 = (uint32_t) bits;
+		memcpy(&value, &bits32, sizeof(T));
+	} else {
+		memcpy(&value, &bits, sizeof(T));
+	}
+
+	return value;
+}
+
+/**
+ * @brief Writes an unaligned value of 4 or 8 bytes in network byte order
+ */
+
+template<typename T>
+inline void wire_put(uint8_t *p, T value)
+{
+	uint64_t bits = 0;
+
+	if (sizeof(T) == sizeof(uint32_t)) {
+		uint32_t bits32;
+		memcpy(&bits32, &value, sizeof(T));
+		bits = bits32;
+	} else {
+		memcpy(&bits, &value, sizeof(T));
+	}
+	for (uint8_t i = sizeof(T); i > 0; i--) {
+		p[i - 1] = bits & 0xFF;
+		bits >>= 8;
+	}
+}
+
+/**
+ * @brief Type of the field of a parameter, only the types below can be 
+ * 	  parameters of a service
+ */
+
+template<typename T> struct wire_field;
+template<> struct wire_field<int32_t> { enum { type = WIRE_INT32 }; };
+template<> struct wire_field<uint32_t> { enum { type = WIRE_UINT32 }; };
+template<> struct wire_field<int64_t> { enum { type = WIRE_INT64 }; };
+template<> struct wire_field<uint64_t> { enum { type = WIRE_UINT64 }; };
+template<> struct wire_field<float32_t> { enum { type = WIRE_FLOAT32 }; };
+template<> struct wire_field<float64_t> { enum { type = WIRE_FLOAT64 }; };
+
+/**
+ * @brief Computes the length of the fields of the parameters
+ */
+
+template<typename... Types>
+struct wire_fields_size { enum { value = 0 }; };
+
+template<typename head, typename... tail>
+struct wire_fields_size<head, tail...> {
+	enum { value = FIELD_HEADER_SIZE + sizeof(head) + 
+		wire_fields_size<tail...>::value };
+};
+
+/**
+ * @brief Computes the length of an operation with the given parameters
+ * @return It returns the length, header included
+ */
+
+template<typename... Types>
+inline constexpr uint32_t wire_op_size()
+{
+	return OP_HEADER_SIZE + wire_fields_size<Types...>::value;
+}
+
+/**
+ * @brief Function used to serialize the parameters as the fields of an
+ * 	  operation
+ * @param p Where to write the fields
+ * @return It returns the end of the fields
+ */
+
+inline uint8_t *serialize(uint8_t *p) { return p; }
 
 template<typename head, typename... tail>
-void serialize(std::string &str, head h, tail... t)
+uint8_t *serialize(uint8_t *p, head h, tail... t)
+{
+	p[0] = wire_field<head>::type;
+	wire_put16(p + 1, sizeof(head));
+	wire_put<head>(p + FIELD_HEADER_SIZE, h);
+
+	return serialize(p + FIELD_HEADER_SIZE + sizeof(head), t...);
+}
+
+/**
+ * @brief Function used to serialize the parameters as an operation
+ * @param p Where to write the operation
+ * @return It returns the end of the operation
+ */
+
+template<typename... Types>
+uint8_t *serialize_op(uint8_t *p, Types... args)
+{
+	static_assert(wire_op_size<Types...>() <= MAX_OP_SIZE, 
+		"operation too long");
+
+	wire_put16(p, wire_op_size<Types...>() - OP_HEADER_SIZE);
+
+	return serialize(p + OP_HEADER_SIZE, args...);
+}
+
+template<std::size_t... I>
+struct index_sequence {};
+
+template<std::size_t N, std::size_t... I>
+struct make_index_sequence : make_index_sequence<N - 1, N - 1, I...> {};
+
+template<std::size_t... I>
+struct make_index_sequence<0, I...> : index_sequence<I...> {};
+
+template<typename tuple_t, std::size_t... I>
+uint8_t *serialize_tuple(uint8_t *p, const tuple_t &t, index_sequence<I...>)
+{
+	return serialize_op(p, std::get<I>(t)...);
+}
+
+/**
+ * @brief Function used to serialize the parameters of a tuple as an 
+ * 	  operation
+ * @param p Where to write the operation
+ * @param t Tuple of parameters
+ * @return It returns the end of the operation
+ */
+
+template<typename... Types>
+uint8_t *serialize_tuple(uint8_t *p, const std::tuple<Types...> &t)
+{
+	return serialize_tuple(p, t, make_index_sequence<sizeof...(Types)>());
+}
+
+/**
+ * @class wire_reader_t
+ * @brief Bytes of a message still to be read, the message is read in place
+ */
+
+struct wire_reader_t {
+	const uint8_t *pos;
+	const uint8_t *end;
+};
+
+/**
+ * @brief Reads the next operation of a sequence
+ * @param ops Operations still to be read, it is advanced past the operation
+ * @param op Where to store the fields of the operation
+ * @return It returns false if the operation is truncated
+ */
+
+inline bool wire_next_op(wire_reader_t &ops, wire_reader_t &op)
+{
+	uint16_t size;
+
+	if (ops.end - ops.pos < OP_HEADER_SIZE)
+		return false;
+	size = wire_get16(ops.pos);
+	if (ops.end - ops.pos - OP_HEADER_SIZE < size)
+		return false;
+	op.pos = ops.pos + OP_HEADER_SIZE;
+	op.end = op.pos + size;
+	ops.pos = op.end;
+
+	return true;
+}
+
+/**
+ * @brief Checks that the operations of a message are well formed, so that
+ * 	  they can be forwarded without being parsed
+ * @param data First operation
+ * @param size Length of the operations
+ * @param num_ops Number of operations expected
+ * @return It returns true if exactly num_ops operations fill the length and
+ * 	   their fields are not truncated
+ */
+
+inline bool wire_check_ops(const uint8_t *data, size_t size, uint32_t num_ops)
 {
-	str.append(std::to_string(h) + " ");
-	serialize(str, t...);
+	wire_reader_t ops = {data, data + size}, op;
+
+	for (uint32_t i = 0; i < num_ops; i++) {
+		if (!wire_next_op(ops, op))
+			return false;
+		while (op.pos < op.end) {
+			if (op.end - op.pos < FIELD_HEADER_SIZE ||
+				op.end - op.pos - FIELD_HEADER_SIZE < 
+				wire_get16(op.pos + 1))
+				return false;
+			op.pos += FIELD_HEADER_SIZE + wire_get16(op.pos + 1);
+		}
+	}
+
+	return ops.pos == ops.end;
 }
 
 /**
- * @brief Function used to deserialize the parameters stream
- * @param params Stringstream used to parse the parameters
+ * @brief Function used to deserialize the fields of an operation
+ * @param op Fields still to be read
+ * @return It returns false if a field is missing or has a different type
  */
 
-inline void deserialize(std::stringstream& params) {}
+inline bool deserialize(wire_reader_t &op) { return true; }
 
 template<typename head, typename... tail>
-void deserialize(std::stringstream& params, head& h, tail&... t)
+bool deserialize(wire_reader_t &op, head& h, tail&... t)
 {
-	params >> h;
-	deserialize(params, t...);
+	if (op.end - op.pos < (int64_t) (FIELD_HEADER_SIZE + sizeof(head)) ||
+		op.pos[0] != wire_field<head>::type ||
+		wire_get16(op.pos + 1) != sizeof(head))
+		return false;
+	h = wire_get<head>(op.pos + FIELD_HEADER_SIZE);
+	op.pos += FIELD_HEADER_SIZE + sizeof(head);
+
+	return deserialize(op, t...);
 }
 
 #endif /* INCLUDE_COMMUNICATION_HPP_ */
\ No newline at end of file
@@ -4,7 +4,7 @@
 
 #include "health_checker_class.hpp"
 
-#define HB_ARGS 2
+#define HB_ARGS 3
 
 
 class  HealthCheckerServer: public HealthChecker {
@@ -12,12 +12,14 @@ class  HealthCheckerServer: public HealthChecker {
 private:
 	uint8_t server_id;
 	uint8_t service;
+	/* Group of the copy, it is passed again at the restart */
+	uint8_t group;
 	
 	
 	void restart_process();
 public:
 	HealthCheckerServer(pid_t pid, uint16_t port, uint8_t server_id, 
-		uint8_t service);
+		uint8_t service, uint8_t group);
 	void step();
 	~HealthCheckerServer();
 };
@@ -0,0 +1,133 @@
+/*
+ *	logger_class.hpp
+ *
+ */
+
+#ifndef INCLUDE_LOGGER_CLASS_HPP_
+#define INCLUDE_LOGGER_CLASS_HPP_
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <stdio.h>
+#include <time.h>
+#include "types.hpp"
+
+//#define CONSOLE_LOG
+#define ABS_YEAR 1900
+
+/* Levels of the log rows */
+#define LOG_LEVEL_ERROR 0
+#define LOG_LEVEL_WARNING 1
+#define LOG_LEVEL_INFO 2
+#define LOG_LEVEL_DEBUG 3
+
+/* The rows above this level are compiled out */
+#ifndef LOG_LEVEL_MAX
+#define LOG_LEVEL_MAX LOG_LEVEL_DEBUG
+#endif
+
+/* Rows of the ring of each thread, a row is dropped if the ring is full */
+#define LOG_RING_SLOTS 4096
+/* Longer names and texts are truncated */
+#define LOG_WHO_SIZE 32
+#define LOG_WHAT_SIZE 472
+/* Period of the flusher */
+#define LOG_FLUSH_MS 50
+/* Environment variable with the initial level of the rows written */
+#define LOG_LEVEL_ENV "RSF_LOG_LEVEL"
+
+/* Writes a log row, the arguments are not evaluated if the level is
+ * filtered */
+#define WRITE_LOG(level, who, what) \
+	do { \
+		if ((level) <= LOG_LEVEL_MAX && log_enabled(level)) \
+			write_log(level, who, what); \
+	} while (0)
+
+/**
+ * @class log_entry_t
+ * @brief Row written by a thread, formatted by the flusher
+ */
+
+struct log_entry_t {
+	struct timespec time;
+	uint8_t level;
+	uint8_t who_len;
+	uint16_t what_len;
+	char_t who[LOG_WHO_SIZE];
+	char_t what[LOG_WHAT_SIZE];
+};
+
+/**
+ * @class log_ring_t
+ * @brief Single producer single consumer ring of the rows of a thread
+ */
+
+struct log_ring_t {
+	/* Next row to be flushed, written by the flusher */
+	alignas(64) std::atomic<uint32_t> head;
+	/* Next free row, written by the thread */
+	alignas(64) std::atomic<uint32_t> tail;
+	/* Rows dropped because the ring was full */
+	std::atomic<uint64_t> dropped;
+	log_entry_t entries[LOG_RING_SLOTS];
+};
+
+/**
+ * @class Logger
+ * @file logger_class.hpp
+ * @brief Asynchronous logger of a process. Each thread writes its rows in
+ * 	  its own ring without locks, a flusher thread formats them and
+ * 	  writes them in batches to the files log/<who>.txt, which are kept
+ * 	  open.
+ */
+
+class Logger {
+
+private:
+	/* Rings of the threads, a ring is never released */
+	std::vector<log_ring_t*> rings;
+	std::mutex rings_mutex;
+	/* Files of the writers, opened at their first row */
+	std::unordered_map<std::string, FILE*> files;
+	std::thread flusher;
+	std::mutex wake_mutex;
+	std::condition_variable wake;
+	std::atomic<bool> stopping;
+
+	log_ring_t *get_ring();
+	FILE *get_file(const std::string &who);
+	void flush();
+	void run();
+
+	Logger();
+public:
+	static Logger &instance();
+	void write(uint8_t level, const std::string &who,
+		const std::string &what);
+	~Logger();
+};
+
+/* Level of the rows written, it can be changed at runtime */
+extern std::atomic<uint8_t> log_level;
+
+/**
+ * @brief Checks if the rows of a level are written
+ */
+
+inline bool log_enabled(uint8_t level)
+{
+	return level <= log_level.load(std::memory_order_relaxed);
+}
+
+extern void set_log_level(uint8_t level);
+
+extern void write_log(uint8_t level, const std::string &who,
+	const std::string &what);
+
+#endif /* INCLUDE_LOGGER_CLASS_HPP_ */
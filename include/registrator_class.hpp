@@ -16,6 +16,12 @@ class Registrator {
 private:
 	/* Type of server service */
 	service_type_t service;
+	/* Identifier among the server copies */
+	uint8_t id;
+	/* Group of the copy */
+	uint8_t group;
+	/* Identity of the socket receiving the requests */
+	std::string identity;
 	/* Broker Address */
 	std::string broker_address;
 	/* Broker Port for registering server copies */
@@ -24,8 +30,9 @@ public:
 	zmq::socket_t *reg;
 
 	Registrator(std::string broker_address, service_type_t service, 
+		uint8_t id, uint8_t group, std::string identity, 
 		uint16_t reg_port, zmq::context_t *ctx);
-	int32_t registration();
+	int32_t registration(uint8_t *transport);
 	~Registrator();
 };
 
@@ -0,0 +1,151 @@
+/*
+ * request_table_class.hpp
+ *
+ */
+
+#ifndef INCLUDE_REQUEST_TABLE_CLASS_HPP_
+#define INCLUDE_REQUEST_TABLE_CLASS_HPP_
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <time.h>
+#include <zmq.hpp>
+#include "types.hpp"
+#include "service.hpp"
+#include "voter.hpp"
+
+#define REQUEST_NOT_FOUND 0xFFFFFFFF
+
+/**
+ * @class waiter_t
+ * @brief Client request coalesced with an identical pending request
+ */
+
+struct waiter_t {
+	/* Identity frame of the client */
+	std::string client_id;
+	/* Identifier of the request chosen by the client */
+	uint32_t request_id;
+};
+
+/**
+ * @class result_digest_t
+ * @brief Distinct digest received for the payload of a request
+ */
+
+struct result_digest_t {
+	digest_t digest;
+	/* Result word of the replies with this digest */
+	int32_t word;
+};
+
+/**
+ * @class request_record_t
+ * @brief Instance for a client request
+ */
+struct request_record_t {
+	/* Identity frame of the client */
+	std::string client_id;
+	/* Seq. number of the request forwarded to the servers */
+	uint32_t seq_id;
+	/* Identifier of the request chosen by the client */
+	uint32_t request_id;
+	/* Number of operations of the batch */
+	uint32_t num_ops;
+	/* Parameters of the request if its results are cached or if it
+	 * can be coalesced, otherwise it is empty */
+	std::string params_key;
+	/* Identical requests attached to this one, they receive the same
+	 * response */
+	std::vector<waiter_t> waiters;
+	/* Voter of each operation, updated as the replies arrive */
+	std::vector<voter_t> voters;
+	/* True if the result is voted on the digest of its payload */
+	bool digest_voting;
+	/* Distinct digests received, the voter of the operation counts 
+	 * the index of the digest of each reply */
+	std::vector<result_digest_t> digests;
+	/* Number of operations whose vote is still pending */
+	uint32_t pending_ops;
+	/* False if the majority is impossible for an operation */
+	bool reliable;
+	/* Number of replies received */
+	uint8_t num_replies;
+	/* Bitmask of the server copies the request has been sent to and 
+	 * of the copies that have replied */
+	uint32_t dispatched_mask;
+	uint32_t replied_mask;
+	/* Copies selected for the request but held back in duplex mode, 
+	 * they receive it on a disagreement or a timeout */
+	uint32_t reserve_mask;
+	/* Frames sent to the copies, kept by reference until the request 
+	 * is escalated */
+	std::shared_ptr<std::vector<zmq::message_t>> held;
+	/* Time the request has been sent to the copies */
+	struct timespec sent;
+	/* Group of the copies the request has been sent to */
+	uint8_t group;
+	/* Service type */
+	service_type_t service;
+	/* Timeout for the request */ 
+	struct timespec timeout;
+	/* Timer armed in the request timer wheel */
+	uint32_t timer;
+	/* True if the slot of the table holds a pending request */
+	bool in_use;
+};
+
+/**
+ * @class request_key_t
+ * @brief Key used to correlate the replies with a pending request
+ */
+
+struct request_key_t {
+	std::string client_id;
+	uint32_t seq_id;
+
+	bool operator==(const request_key_t &k) const {
+		return seq_id == k.seq_id && client_id == k.client_id;
+	}
+};
+
+struct request_key_hash
+{
+	std::size_t operator()(const request_key_t &k) const {
+		return std::hash<std::string>()(k.client_id) ^ 
+			((std::size_t) k.seq_id * 0x9E3779B97F4A7C15ULL);
+	}
+};
+
+/**
+ * @class RequestTable
+ * @file request_table_class.hpp
+ * @brief Table of the pending requests of a service. Records are kept in
+ * 	  stable slots, so a slot index can be used as an handle until the 
+ * 	  request is removed, and they are indexed by (client, seq. id).
+ */
+
+class RequestTable {
+
+private:
+	/* Slots of the table */
+	std::vector<request_record_t> records;
+	/* Slots that can be reused */
+	std::vector<uint32_t> free_slots;
+	/* Index from the request key to the slot */
+	std::unordered_map<request_key_t, uint32_t, request_key_hash> index;
+public:
+	uint32_t insert(request_record_t *request_record);
+	uint32_t find(const std::string &client_id, uint32_t seq_id);
+	request_record_t *get(uint32_t slot);
+	void remove(uint32_t slot);
+	uint32_t capacity();
+	uint32_t size();
+
+	RequestTable();
+	~RequestTable();
+};
+
+#endif /* INCLUDE_REQUEST_TABLE_CLASS_HPP_ */
@@ -0,0 +1,68 @@
+/*
+ * result_cache_class.hpp
+ *
+ */
+
+#ifndef INCLUDE_RESULT_CACHE_CLASS_HPP_
+#define INCLUDE_RESULT_CACHE_CLASS_HPP_
+
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <time.h>
+#include "types.hpp"
+
+/**
+ * @class cache_entry_t
+ * @brief Voted results of a request
+ */
+
+struct cache_entry_t {
+	/* Parameters of the request */
+	std::string key;
+	/* Results of the operations in network byte order */
+	std::vector<int32_t> results;
+	/* The entry is valid until this time */
+	struct timespec expiry;
+};
+
+/**
+ * @class ResultCache
+ * @file result_cache_class.hpp
+ * @brief LRU cache of the voted results of a deterministic service, keyed
+ * 	  by the serialized parameters of the request. Entries expire after
+ * 	  a time to live. The cache is disabled until it is configured with
+ * 	  a size greater than zero.
+ */
+
+class ResultCache {
+
+private:
+	/* Maximum number of entries, 0 if the cache is disabled */
+	uint32_t max_size;
+	/* Time to live of the entries in milliseconds */
+	uint32_t ttl_ms;
+	/* Entries from the most to the least recently used */
+	std::list<cache_entry_t> lru;
+	/* Index from the key to the entry */
+	std::unordered_map<std::string,
+		std::list<cache_entry_t>::iterator> index;
+	/* Counters */
+	uint64_t hits;
+	uint64_t misses;
+public:
+	void configure(uint32_t max_size, uint32_t ttl_ms);
+	bool enabled();
+	const std::vector<int32_t> *lookup(const std::string &key);
+	void insert(const std::string &key, const int32_t *results,
+		uint32_t num_results);
+	uint64_t get_hits();
+	uint64_t get_misses();
+	uint32_t size();
+
+	ResultCache();
+	~ResultCache();
+};
+
+#endif /* INCLUDE_RESULT_CACHE_CLASS_HPP_ */
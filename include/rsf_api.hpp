@@ -4,11 +4,98 @@
 #include <zmq.hpp>
 #include <string>
 #include <iostream>
+#include <future>
+#include <functional>
+#include <type_traits>
+#include <vector>
+#include <unordered_map>
 #include "types.hpp"
 #include "service.hpp"
 #include "communication.hpp"
+#include "service_registry.hpp"
 
 #define MAX_LENGTH_SIGNATURE 32
+/* Max length of the identity of a server copy */
+#define MAX_LENGTH_REPLICA_ID 16
+/* Default number of requests in flight for an asynchronous client */
+#define DEFAULT_WINDOW 1024
+
+/**
+ * @brief Initializes the request module at the beginning of a data frame
+ * @param data Data frame of the request
+ * @param service Requested service
+ * @param request_id Identifier of the request
+ * @param num_ops Number of operations of the request
+ */
+
+inline void init_request_module(void *data, service_type_t service, 
+	uint32_t request_id, uint32_t num_ops)
+{
+	request_module *rm = static_cast<request_module*> (data);
+
+	rm->version = WIRE_VERSION;
+	memset(rm->reserved, 0, sizeof(rm->reserved));
+	rm->service = htonl((uint32_t) service);
+	rm->request_id = htonl(request_id);
+	rm->num_ops = htonl(num_ops);
+}
+
+/**
+ * @brief Builds the data frame of a request for a single operation
+ * @param request Message to be filled
+ * @param service Requested service
+ * @param request_id Identifier of the request
+ * @param args Parameters of the service
+ */
+
+template<typename... Types>
+void build_request(zmq::message_t &request, service_type_t service, 
+	uint32_t request_id, Types... args)
+{
+	request.rebuild(sizeof(request_module) + wire_op_size<Types...>());
+	init_request_module(request.data(), service, request_id, 1);
+	serialize_op(module_params<request_module>(request.data()), args...);
+}
+
+/**
+ * @brief Builds the data frame of a request for a batch of operations
+ * @param request Message to be filled
+ * @param service Requested service
+ * @param request_id Identifier of the request
+ * @param batch Parameters of each operation
+ */
+
+template<typename... Types>
+void build_batch_request(zmq::message_t &request, service_type_t service, 
+	uint32_t request_id, const std::vector<std::tuple<Types...>> &batch)
+{
+	uint8_t *op;
+
+	request.rebuild(sizeof(request_module) + batch.size() * 
+		wire_op_size<Types...>());
+	init_request_module(request.data(), service, request_id, batch.size());
+	op = module_params<request_module>(request.data());
+	for (uint32_t i = 0; i < batch.size(); i++)
+		op = serialize_tuple(op, batch[i]);
+}
+
+/**
+ * @brief Builds the data frame of a request for a service declared in the
+ * 	  registry, the parameters are converted to the types of the service
+ * @param request Message to be filled
+ * @param request_id Identifier of the request
+ * @param args Parameters of the service
+ */
+
+template<service_type_t service, typename... Types>
+void build_service_request(zmq::message_t &request, uint32_t request_id,
+	Types... args)
+{
+	request.rebuild(sizeof(request_module) + service_def<service>::op_size());
+	init_request_module(request.data(), service, request_id, 1);
+	service_def<service>::serialize_args(
+		module_params<request_module>(request.data()), args...);
+}
 
 class RSF_Client {
 	
@@ -18,6 +105,13 @@ private:
 	zmq::socket_t *socket;
 	std::string broker_addr;
 	uint16_t broker_port;
+	uint32_t next_request_id;
+	/* Results of the last request */
+	std::vector<int32_t> results;
+
+	bool send_request(zmq::message_t &request, 
+		std::vector<int32_t> &results, const payload_t *payload = NULL,
+		payload_t *result_payload = NULL);
 	
 public:
 	
@@ -28,36 +122,210 @@ public:
 	bool request_service(service_type_t service, int32_t& result, 
 		Types... args)
 	{
-		response_module response;
-		std::string serialized;
-		request_module rm;
+		zmq::message_t request;
 	
-		/* Serialize the parameters */
-		serialize(serialized, args...);
-
-		std::strcpy (rm.parameters, serialized.c_str());
-		rm.service = (service_type_t) htonl((uint32_t) service);
-
-		/* Service Request */
-		zmq::message_t request(sizeof(request_module));
-		memcpy(request.data(), (void *) &rm, sizeof(request_module));
-		socket->send(request);
-        
-		/* Get response module */
-		zmq::message_t reply;
-		socket->recv(&reply);
-		response = *(static_cast<response_module*> (reply.data()));
-		if (ntohl(response.service_status) == SERVICE_NOT_RELIABLE) {
-			std::cout << "Service not reliable" << std::endl;
+		build_request(request, service, next_request_id++, args...);
+		if (!send_request(request, results))
+			return false;
+		result = results[0];
+
+		return true;
+	}
+
+	/**
+	 * @brief Requests a service declared in the registry, the types of 
+	 * 	  the parameters and of the result are checked at compile time
+	 * @param result Where to store the voted result
+	 * @param args Parameters of the service
+	 * @return true if the result is reliable, false otherwise
+	 */
+
+	template<service_type_t service, typename... Types>
+	bool call(typename service_def<service>::result_type &result,
+		Types... args)
+	{
+		zmq::message_t request;
+
+		build_service_request<service>(request, next_request_id++,
+			args...);
+		if (!send_request(request, results))
 			return false;
-		} else if (ntohl(response.service_status) ==  SERVICE_NOT_AVAILABLE) {
-			std::cout << "Service not available" << std::endl;
+		result = service_def<service>::get_result(results[0]);
+
+		return true;
+	}
+
+	/**
+	 * @brief Requests a service declared in the registry that works on 
+	 * 	  a payload, the payload is sent in separate frames
+	 * @param result Where to store the payload of the voted result
+	 * @param payload Payload of the request
+	 * @param args Parameters of the service
+	 * @return true if the result is reliable, false otherwise
+	 */
+
+	template<service_type_t service, typename... Types>
+	bool call_payload(payload_t &result, const payload_t &payload,
+		Types... args)
+	{
+		zmq::message_t request;
+
+		static_assert(std::is_same<typename service_def<service>::
+			result_type, payload_t>::value, 
+			"the service does not return a payload");
+		build_service_request<service>(request, next_request_id++,
+			args...);
+		result.clear();
+
+		return send_request(request, results, &payload, &result);
+	}
+
+	/**
+	 * @brief Requests a batch of operations with a single message
+	 * @param service Requested service
+	 * @param results Where to store the voted result of each operation
+	 * @param batch Parameters of each operation
+	 * @return true if all the results are reliable, false otherwise
+	 */
+
+	template<typename... Types>
+	bool request_service_batch(service_type_t service, 
+		std::vector<int32_t> &results, 
+		const std::vector<std::tuple<Types...>> &batch)
+	{
+		zmq::message_t request;
+
+		if (batch.empty() || batch.size() > MAX_BATCH_OPS) {
+			std::cout << "Invalid batch size" << std::endl;
 			return false;
 		}
-		result = (int32_t) ntohl(response.result);
+		build_batch_request(request, service, next_request_id++, batch);
 
-		return true;
+		return send_request(request, results);
+	}
+};
+
+/**
+ * @brief      Outcome of an asynchronous request
+ */
+
+struct rsf_response_t {
+	uint32_t request_id;
+	service_status_t service_status;
+	int32_t result;
+};
+
+typedef std::function<void(const rsf_response_t&)> completion_cb_t;
+
+/**
+ * @brief      Request waiting for the response of the broker
+ */
+
+struct pending_call_t {
+	/* If empty the promise is fulfilled */
+	completion_cb_t callback;
+	std::promise<rsf_response_t> promise;
+};
+
+/**
+ * @class RSF_AsyncClient
+ * @file rsf_api.hpp
+ * @brief Client that pipelines the requests on a DEALER socket. Every 
+ * 	  request carries its own id, so up to 'window' requests can be in 
+ * 	  flight and are completed in any order, either fulfilling a future 
+ * 	  or calling a completion callback. The object is not thread safe.
+ */
+
+class RSF_AsyncClient {
+
+private:
+
+	zmq::context_t *context;
+	zmq::socket_t *socket;
+	uint32_t next_request_id;
+	/* Max number of requests in flight */
+	uint32_t window;
+	/* Requests waiting for the response */
+	std::unordered_map<uint32_t, pending_call_t> in_flight;
+
+	uint32_t send_request(zmq::message_t &request, pending_call_t &call);
+
+public:
+
+	RSF_AsyncClient(std::string addr, uint16_t port, 
+		uint32_t window = DEFAULT_WINDOW);
+	~RSF_AsyncClient();
+
+	/**
+	 * @brief Sends a request whose response fulfills the returned future
+	 * @param service Requested service
+	 * @param args Parameters of the service
+	 * @return It returns the future of the response
+	 */
+
+	template<typename... Types>
+	std::future<rsf_response_t> request_service(service_type_t service, 
+		Types... args)
+	{
+		zmq::message_t request;
+		pending_call_t call;
+		std::future<rsf_response_t> ret = call.promise.get_future();
+
+		build_request(request, service, next_request_id, args...);
+		send_request(request, call);
+
+		return ret;
+	}
+
+	/**
+	 * @brief Sends a request for a service declared in the registry, 
+	 * 	  the result of the response is converted with
+	 * 	  service_def<service>::get_result()
+	 * @param args Parameters of the service
+	 * @return It returns the future of the response
+	 */
+
+	template<service_type_t service, typename... Types>
+	std::future<rsf_response_t> call(Types... args)
+	{
+		zmq::message_t request;
+		pending_call_t pending;
+		std::future<rsf_response_t> ret = 
+			pending.promise.get_future();
+
+		build_service_request<service>(request, next_request_id, 
+			args...);
+		send_request(request, pending);
+
+		return ret;
+	}
+
+	/**
+	 * @brief Sends a request whose response is notified by a callback
+	 * @param service Requested service
+	 * @param callback Function called by process_replies()
+	 * @param args Parameters of the service
+	 * @return It returns the id of the request
+	 */
+
+	template<typename... Types>
+	uint32_t request_service_cb(service_type_t service, 
+		completion_cb_t callback, Types... args)
+	{
+		zmq::message_t request;
+		pending_call_t call;
+
+		call.callback = callback;
+		build_request(request, service, next_request_id, args...);
+
+		return send_request(request, call);
 	}
+
+	uint32_t process_replies(int64_t timeout);
+	void wait_all();
+	int32_t get_fd();
+	uint32_t get_in_flight();
+	void set_window(uint32_t window);
 };
 
 /**
@@ -67,9 +335,29 @@ public:
 struct registration_module {
 	char_t signature[MAX_LENGTH_SIGNATURE];
 	service_type_t service;
+	/* Identifier among the server copies */
+	uint8_t id;
+	/* Group of the copy, the requests are voted within a group */
+	uint8_t group;
+	/* Identity of the socket used by the copy to receive the requests,
+	 * the broker addresses the copy by this identity */
+	char_t identity[MAX_LENGTH_REPLICA_ID];
+};
+
+/**
+ * @brief      reply of the broker to a registration
+ */
+
+struct registration_reply_t {
+	/* Backend port of the service, 0 if the registration failed */
+	uint16_t port;
+	/* Transport of the backend of the service */
+	uint8_t transport;
+	uint8_t reserved;
 };
 
-extern int32_t register_service(registration_module *, zmq::socket_t *);
+extern int32_t register_service(registration_module *, zmq::socket_t *,
+	uint8_t *);
 
 /**
  * @brief Function used by a client to request a service
@@ -0,0 +1,43 @@
+/*
+ *	sequence_window_class.hpp
+ *
+ */
+
+#ifndef INCLUDE_SEQUENCE_WINDOW_CLASS_HPP_
+#define INCLUDE_SEQUENCE_WINDOW_CLASS_HPP_
+
+#include "types.hpp"
+
+/* Seq ids remembered below the highest one received, multiple of 64 */
+#define SEQ_WINDOW_SIZE 1024
+#define SEQ_WINDOW_WORDS (SEQ_WINDOW_SIZE / 64)
+
+/**
+ * @class SequenceWindow
+ * @file sequence_window_class.hpp
+ * @brief Sliding window over the seq ids of the requests received by a
+ * 	  copy. The requests can arrive in any order, a seq id is accepted
+ * 	  once and the ones older than the window are taken as duplicates.
+ * 	  The ids are compared modulo 2^32, so they can wrap.
+ */
+
+class SequenceWindow {
+
+private:
+	/* Bit seq_id % SEQ_WINDOW_SIZE is set if seq_id has been received */
+	uint64_t received[SEQ_WINDOW_WORDS];
+	/* Highest seq id received */
+	uint32_t top;
+	bool empty;
+
+	void set(uint32_t seq_id, bool value);
+	bool test(uint32_t seq_id);
+public:
+	bool accept(uint32_t seq_id);
+	void reset();
+	uint32_t get_top();
+
+	SequenceWindow();
+};
+
+#endif /* INCLUDE_SEQUENCE_WINDOW_CLASS_HPP_ */
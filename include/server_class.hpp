@@ -11,21 +11,26 @@
 #include <sstream>
 #include <unistd.h>
 #include <functional>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <unordered_map>
 #include "types.hpp"
 #include "service.hpp"
+#include "service_registry.hpp"
 #include "registrator_class.hpp"
+#include "shm_channel_class.hpp"
+#include "worker_pool_class.hpp"
+#include "sequence_window_class.hpp"
 
-#define SERVICE_REQUEST_INDEX 1
-#define REGISTRATION_INDEX 1
 #define SERVER_PONG_INDEX 0
-
-struct service_thread_t {
-	std::string parameters;
-	service_body service;
-	service_type_t service_type;
-	uint8_t id;
-	zmq::socket_t *skt;
-};
+/* Poll item of the completions of the workers */
+#define COMPLETION_INDEX 1
+#define SERVICE_REQUEST_INDEX 2
+/* Poll item of the shared memory channel, if the copy has one */
+#define SHM_CHANNEL_INDEX 3
+/* Type of a malformed message from the broker, it is ignored */
+#define SM_INVALID 0xFF
 
 class RSF_Server {
 
@@ -35,11 +40,14 @@ private:
 	/* Service type that must be provided */
 	service_type_t service_type;
 	/* Service to be provided */
-	service_body service;
+	service_executor service;
 	/* Ping seq id */
 	uint32_t ping_id;
-	/* Ping request id */
-	uint32_t request_id;
+	/* Seq ids of the requests received, to detect the duplicates */
+	SequenceWindow requests;
+	/* Identity of the reply socket, the broker addresses this copy 
+	 * by it */
+	std::string identity;
 	/* Address and port for communication */
 	std::string broker_address;
 	int32_t broker_port;
@@ -47,26 +55,56 @@ private:
 	zmq::context_t *context;
 	zmq::socket_t *reply;
 	zmq::socket_t *hc_pong;
+	/* Transport of the backend of the service */
+	uint8_t transport;
+	/* Channel in shared memory with the broker, NULL if the messages go
+	 * through the reply socket */
+	ShmChannel *channel;
+	/* Template of the requests submitted to the workers */
 	service_thread_t service_thread;
+	/* Cancellation flags of the requests being elaborated */
+	std::unordered_map<uint32_t, 
+		std::shared_ptr<std::atomic<bool>>> running;
+	/* Workers elaborating the requests */
+	WorkerPool *pool;
 	/* Registrator to register this unit to the broker */
 	Registrator *registrator;
 	/* Poll set */
 	std::vector<zmq::pollitem_t> items;
+	/* True to poll without blocking, for the lowest latency */
+	bool busy_poll;
 	/* Identificator used for logging */
 	std::string my_name;
 	
 	/* Receive requests from the broker */
-	bool receive_request(char_t *val, uint32_t *received_id);
+	uint8_t receive_request(std::shared_ptr<zmq::message_t> &request, 
+		std::shared_ptr<payload_t> &payload, uint32_t *received_id, 
+		std::string &client_id);
+	/* Send a message to the broker with the envelope of a client */
+	void send_broker(const std::string &client_id, zmq::message_t &msg,
+		const std::shared_ptr<payload_t> &payload = 
+		std::shared_ptr<payload_t>());
+	/* Hand a shared memory channel over to the broker */
+	void attach_channel();
 	/* Send a pong to the broker */
 	void pong_broker();
+	/* Cancel a request that is being elaborated */
+	void cancel_request(uint32_t seq_id);
+	/* Send the replies of the elaborated requests */
+	void send_completions();
+	/* Log the load of the workers */
+	void log_pool();
 	/* Receive the ping and send back a pong to the health checker */
 	void pong_health_checker();
-	/* Function for creating a thread that elaborates a request */
-	void create_thread(std::string parameter);
+	/* Function for submitting a request to the workers */
+	void submit_request(std::shared_ptr<zmq::message_t> &request, 
+		std::shared_ptr<payload_t> &payload, uint32_t seq_id, 
+		const std::string &client_id);
 
 public:
-	RSF_Server(uint8_t id, uint8_t service, std::string broker_addr,
-		uint16_t broker_port);
+	RSF_Server(uint8_t id, uint8_t group, uint8_t service, 
+		std::string broker_addr, uint16_t broker_port);
+	void enable_busy_poll(int32_t cpu);
 	void step();
 	~RSF_Server();
 };
@@ -6,19 +6,23 @@
 #ifndef INCLUDE_SERVICE_HPP_
 #define INCLUDE_SERVICE_HPP_
 
+#include <string>
 #include "types.hpp"
-#include <functional>
 
+/* The services are declared with their types in service_registry.hpp, 
+ * NUM_SERVICES must stay the last value */
 enum service_type_t {
-	INCREMENT, DECREMENT, MULTIPLY2, SUM
+	INCREMENT, DECREMENT, MULTIPLY2, SUM, AVERAGE, INVERT, NUM_SERVICES
 };
 
-typedef int32_t (*service_body)(int32_t);
+/* Bytes of a large parameter or result, carried in separate frames */
+typedef std::string payload_t;
 
-extern service_body get_service_body(service_type_t service);
 extern int32_t increment(int32_t x);
 extern int32_t decrement(int32_t x);
 extern int32_t multiply2(int32_t x);
 extern int32_t sum(int32_t x, int32_t y);
+extern float32_t average(float32_t x, float32_t y);
+extern payload_t invert(const payload_t &tile);
 
 #endif /* INCLUDE_SERVICE_HPP_ */
\ No newline at end of file
@@ -6,108 +6,230 @@
 #ifndef INCLUDE_SERVICE_DATABASE_CLASS_HPP_
 #define INCLUDE_SERVICE_DATABASE_CLASS_HPP_
 #include <string>
+#include <vector>
 #include <unordered_map>
 #include "types.hpp"
 #include "util.hpp"
 #include "service.hpp"
 #include "rsf_api.hpp"
+#include "timer_wheel_class.hpp"
+#include "request_table_class.hpp"
+#include "result_cache_class.hpp"
+#include "shm_channel_class.hpp"
 
 #define SERVICE_NOT_FOUND -1
 #define REG_FAIL 0
+/* Size of the table that maps the service types to the compact ids */
+#define MAX_SERVICES 256
+/* Weight of a new latency sample in the moving average, 1 / 2^shift */
+#define LATENCY_EWMA_SHIFT 3
+/* A copy is quarantined if its latency is above QUARANTINE_MIN_US and 
+ * QUARANTINE_FACTOR times the one of its fastest peer, it is probed again 
+ * after QUARANTINE_MS */
+#define QUARANTINE_FACTOR 4
+#define QUARANTINE_MIN_US 50000
+#define QUARANTINE_MS 10000
+/* Copies a request is sent to in duplex mode, the other selected copies 
+ * are asked only if they disagree or don't answer in time */
+#define DUPLEX_COPIES 2
 
 /**
- * @class request_record_t
- * @brief Instance for a client request
+ * @class replica_t
+ * @brief State of a server copy of a service
  */
-struct request_record_t {
-	/* Unique identifier of the client */
-	uint32_t client_id;
-	/* Container for the responses of the server copies */
-	std::vector<int32_t> results;
-	/* Service type */
-	service_type_t service;
-	/* Timeout for the request */ 
-	struct timespec timeout;
+
+struct replica_t {
+	/* Identity of the copy in the backend socket */
+	char_t identity[MAX_LENGTH_REPLICA_ID];
+	/* Number of pong loss */
+	int8_t lost_pong;
+	/* True if the latency is unknown, the next sample replaces it */
+	bool probing;
+	/* Requests sent to the copy and not answered yet */
+	uint16_t pending;
+	/* Moving average of the latency in microseconds */
+	uint32_t latency_us;
+	/* End of the quarantine */
+	struct timespec quarantine_end;
+	/* Group of the copy */
+	uint8_t group;
+	/* Shared memory channel of a co-located copy, NULL if the copy 
+	 * uses the backend socket */
+	ShmChannel *channel;
+};
+
+/**
+ * @class group_t
+ * @brief Group of nmr server copies of a service, the requests are voted 
+ * 	  within a group
+ */
+
+struct group_t {
+	/* Bitmask of the copies of the group */
+	uint32_t mask;
+	/* Requests sent to the group and not answered yet */
+	uint32_t pending;
 };
 
 /**
  * @class service_record
  * @file service_database_class.hpp
- * @brief record for the service database
+ * @brief record for the service database, the fields used for every 
+ * 	  message come first
  */
  
+template<uint8_t nmr>
 struct service_record { 
-	/* Owner of the service */
-	std::string owner;
-	/* Copies of the group that has registered */
+	/* Service type */
+	service_type_t service;
+	/* True once nmr copies of a group have registered */
+	bool ready;
+	/* Copies that have registered, spares and groups included */
 	uint8_t num_copies_registered;
-	/* Copies of the group that are working correctly */
+	/* Copies that are working correctly */
 	uint8_t num_copies_reliable;
-	/* Dealer socket port for this service */
+	/* Backend socket port for this service and its transport */
 	uint16_t dealer_socket;
-	/* Index to access in the dealer socket list to the dealer socket 
-	 * for this service */
+	uint8_t transport;
+	/* Index to access in the backend socket list to the backend 
+	 * socket for this service */
 	uint16_t dealer_skt_index;
 	/* Seq. number for the ping */
 	uint32_t seq_id_ping;
 	/* Seq. number for the request */
 	uint32_t seq_id_request;
-	/* Vector of active requests from the clients */
-	std::vector<request_record_t> request_records;
-	/* Vectors that points out if in the current timeout it was 
-	 * received a pong from a the server copies and the number 
-	 * of pong loss */
-	std::vector<bool> new_pong;
-	std::vector<int8_t> lost_pong;
-	
+	/* Bitmask of the registered server copies, of the copies that 
+	 * sent a pong in the current timeout, of the copies that are 
+	 * not reliable and of the copies that are too slow */
+	uint32_t registered_mask;
+	uint32_t pong_mask;
+	uint32_t failed_mask;
+	uint32_t quarantine_mask;
+	/* Server copies */
+	replica_t replicas[MAX_REPLICAS];
+	/* Groups of copies */
+	group_t groups[MAX_GROUPS];
+	/* True if the requests with the same parameters are sent to the 
+	 * same group */
+	bool affinity;
+	/* True if the requests are sent to DUPLEX_COPIES copies first */
+	bool duplex;
+	/* Duplex requests and requests escalated to nmr copies */
+	uint64_t duplex_requests;
+	uint64_t escalations;
+	/* Table of active requests from the clients */
+	RequestTable request_records;
+	/* Cache of the voted results */
+	ResultCache cache;
+	/* True if identical pending requests are coalesced */
+	bool coalescing;
+	/* Index from the parameters to the slot of the pending requests 
+	 * that can be coalesced */
+	std::unordered_map<std::string, uint32_t> in_flight;
+	/* Owner of the service */
+	char_t owner[MAX_LENGTH_SIGNATURE];
 };
 
-/* std::unordered_map requires a hash functor in order to do anything.  
- * By default, that hash functor is std::hash<Key> but the standard only 
- * provides specializations for the integral types and pointers.
- * Since we use service_type_t as the key in ServiceDatabase, we provide      
- * this functor to calculate the hash of each record instance.
+/**
+ * @class service_config_t
+ * @brief Configuration of a service for its deterministic results
  */
 
-struct service_type_hash
-{
-    std::size_t operator()(const service_type_t& type) const {
-        return (std::size_t)type;
-    }
+struct service_config_t {
+	/* Maximum number of entries of the result cache, 0 if the cache 
+	 * is disabled */
+	uint32_t cache_size;
+	/* Time to live of the cache entries in milliseconds */
+	uint32_t cache_ttl_ms;
+	/* True if identical pending requests are coalesced */
+	bool coalescing;
+	/* True if the requests with the same parameters are sent to the 
+	 * same group */
+	bool affinity;
+	/* True if the requests are sent to DUPLEX_COPIES copies first */
+	bool duplex;
+	/* Transport of the backend */
+	uint8_t transport;
 };
 
+/**
+ * @class ServiceDatabase
+ * @file service_database_class.hpp
+ * @brief Database of the registered services and of their pending requests,
+ * 	  specialized on the redundancy of the voter. The records are stored 
+ * 	  in a dense array indexed by a compact id, assigned in order of 
+ * 	  registration, and a service is mapped to its id with a single 
+ * 	  array access. The records never move, since the space for 
+ * 	  MAX_SERVICES of them is reserved.
+ */
+
+template<uint8_t nmr>
 class ServiceDatabase {
 
 private:
-	/* Redundancy for the voter */
-	uint8_t nmr;
-	/* Hash table for registered services */
-	std::unordered_map<service_type_t, service_record, 
-	service_type_hash> services_db;
+	/* Records of the registered services indexed by compact id */
+	std::vector<service_record<nmr>> records;
+	/* Compact id of each service type, SERVICE_NOT_FOUND if the
+	 * service is not registered */
+	int16_t service_ids[MAX_SERVICES];
+	/* Configuration of the services, applied at registration */
+	service_config_t service_configs[MAX_SERVICES];
 	/* This is the index of the current available posistion 
 	 * in the dealer socket list */
 	uint16_t next_dealer_skt_index;
+	/* Timers of the pending requests */
+	TimerWheel request_timers;
+	/* Buffer for the expired timers */
+	std::vector<timer_expired_t> expired_timers;
+	/* Buffer for the results to be cached */
+	std::vector<int32_t> cache_buffer;
+
+	uint32_t pick_copies(service_record<nmr> *record, uint32_t candidates,
+		uint32_t selected, uint8_t count);
+	int8_t select_group(service_record<nmr> *record, uint32_t live,
+		const std::string &params_key);
+	void update_latency(service_record<nmr> *record, uint8_t id_copy,
+		struct timespec *now, struct timespec *sent);
+	void classify_digest(request_record_t *request, int32_t *results);
 public:
+	service_record<nmr> *get_record(service_type_t service);
 	uint16_t push_registration(registration_module *reg_mod, 
 		uint16_t &dealer_socket, bool &ready);
-	int32_t find_registration(service_type_t);
-	int32_t push_result(server_reply_t *server_reply, uint32_t client_id);
-	std::vector<int32_t> get_result(service_type_t service, 
-		uint32_t client_id);
-	void push_request(request_record_t *request_record, 
-		service_type_t service);
-	void delete_request(service_type_t service, uint32_t client_id);
-	void register_pong(uint8_t id_copy, service_type_t service);
-	void check_pong(service_type_t service);
-	uint8_t get_reliable_copies(service_type_t service);
-	uint32_t get_ping_id(service_type_t service);
-	std::vector<request_record_t> get_pending_requests(service_type_t 
-		service);
-	uint32_t get_request_id(service_type_t service);
+	vote_status_t push_result(service_record<nmr> *record, uint8_t id_copy,
+		int32_t *results, uint32_t slot);
+	uint32_t select_copies(service_record<nmr> *record, 
+		const std::string &params_key, uint8_t &group, 
+		uint32_t &reserve);
+	uint32_t push_request(service_record<nmr> *record, 
+		request_record_t *request_record, uint32_t dispatched,
+		uint32_t reserve, uint8_t group);
+	uint32_t escalate_request(service_record<nmr> *record, 
+		uint32_t slot);
+	uint32_t find_request(service_record<nmr> *record, 
+		const std::string &client_id, uint32_t seq_id);
+	request_record_t *get_request(service_record<nmr> *record, 
+		uint32_t slot);
+	void delete_request(service_record<nmr> *record, uint32_t slot);
+	void register_pong(service_record<nmr> *record, uint8_t id_copy);
+	void check_pong(service_record<nmr> *record);
+	void set_cache(service_type_t service, uint32_t size, 
+		uint32_t ttl_ms);
+	void cache_result(service_record<nmr> *record, 
+		request_record_t *request);
+	void set_coalescing(service_type_t service, bool enable);
+	void set_affinity(service_type_t service, bool enable);
+	void set_duplex(service_type_t service, bool enable);
+	void set_transport(service_type_t service, uint8_t transport);
+	bool coalesce_request(service_record<nmr> *record, 
+		const std::string &params_key, const std::string &client_id,
+		uint32_t request_id);
+	void get_expired_requests(struct timespec *now, 
+		std::vector<request_record_t> &expired);
+	bool get_next_request_timeout(struct timespec &deadline);
 	void print_htable();
 
-	ServiceDatabase(uint8_t nmr);
+	ServiceDatabase();
 	~ServiceDatabase();
 };
 
-#endif /* INCLUDE_SERVICE_DATABASE_CLASS_HPP_ */
\ No newline at end of file
+#endif /* INCLUDE_SERVICE_DATABASE_CLASS_HPP_ */
@@ -0,0 +1,305 @@
+/*
+ * service_registry.hpp
+ * In this file the services are declared with their types. The decoding of
+ * the parameters, the call and the encoding of the result of each service
+ * are generated at compile time from its signature. A service whose first
+ * parameter and result are payloads works on the payloads of the messages,
+ * its result is voted on the digest of the returned payload.
+ */
+
+#ifndef INCLUDE_SERVICE_REGISTRY_HPP_
+#define INCLUDE_SERVICE_REGISTRY_HPP_
+
+#include <tuple>
+#include <string.h>
+#include "types.hpp"
+#include "service.hpp"
+#include "communication.hpp"
+
+/**
+ * @brief Executes an operation of a service
+ * @param op Fields of the operation
+ * @param in Payload of the request, empty if there is none
+ * @param result Where to store the result in network byte order
+ * @param out Where to store the payload of the result
+ * @return It returns false if the fields don't match the parameters
+ */
+
+typedef bool (*service_executor)(wire_reader_t &op, const payload_t &in,
+	int32_t &result, payload_t &out);
+
+/**
+ * @class service_args
+ * @brief Parameters of a service carried in the fields of an operation
+ */
+
+template<typename... args_t>
+struct service_args {
+
+	typedef std::tuple<args_t...> args_type;
+
+	/**
+	 * @brief Gets the length of an operation of the service
+	 */
+
+	static constexpr uint32_t op_size()
+	{
+		return wire_op_size<args_t...>();
+	}
+
+	/**
+	 * @brief Serializes the parameters as an operation, converting them
+	 * 	  to the types of the service
+	 * @param p Where to write the operation
+	 * @return It returns the end of the operation
+	 */
+
+	template<typename... Types>
+	static uint8_t *serialize_args(uint8_t *p, Types... args)
+	{
+		static_assert(sizeof...(Types) == sizeof...(args_t),
+			"wrong number of parameters");
+
+		return serialize_op<args_t...>(p, static_cast<args_t>(args)...);
+	}
+
+	template<std::size_t... I>
+	static bool check(wire_reader_t &op, index_sequence<I...>)
+	{
+		args_type args;
+
+		return deserialize(op, std::get<I>(args)...);
+	}
+
+	/**
+	 * @brief Checks that the fields of an operation match the parameters,
+	 * 	  the service is not executed
+	 */
+
+	static bool check(wire_reader_t &op)
+	{
+		return check(op, make_index_sequence<sizeof...(args_t)>());
+	}
+};
+
+/**
+ * @class service_impl
+ * @brief Implementation of a service generated from its body. The results
+ * 	  are voted as 32 bit words, so they are compared bit by bit.
+ */
+
+template<typename body_t, body_t body>
+struct service_impl;
+
+template<typename result_t, typename... args_t,
+	result_t (*body)(args_t...)>
+struct service_impl<result_t (*)(args_t...), body> : 
+	service_args<args_t...> {
+
+	static_assert(sizeof(result_t) == sizeof(int32_t),
+		"the results are voted as 32 bit words");
+
+	typedef result_t result_type;
+	typedef std::tuple<args_t...> args_type;
+
+	static constexpr bool returns_payload = false;
+
+	/**
+	 * @brief Gets the result from the word of a response
+	 * @param word Result in host byte order
+	 */
+
+	static result_t get_result(int32_t word)
+	{
+		result_t result;
+
+		memcpy(&result, &word, sizeof(result));
+
+		return result;
+	}
+
+	template<std::size_t... I>
+	static bool call(wire_reader_t &op, int32_t &result,
+		index_sequence<I...>)
+	{
+		args_type args;
+		result_t value;
+		uint32_t word;
+
+		if (!deserialize(op, std::get<I>(args)...))
+			return false;
+		value = body(std::get<I>(args)...);
+		memcpy(&word, &value, sizeof(word));
+		result = (int32_t) htonl(word);
+
+		return true;
+	}
+
+	/**
+	 * @brief Executes an operation, it is the service_executor of the
+	 * 	  service
+	 */
+
+	static bool execute(wire_reader_t &op, const payload_t &in,
+		int32_t &result, payload_t &out)
+	{
+		return call(op, result,
+			make_index_sequence<sizeof...(args_t)>());
+	}
+};
+
+/**
+ * @brief Implementation of a service that takes and returns a payload, its
+ * 	  result word is the length of the returned payload
+ */
+
+template<typename... args_t,
+	payload_t (*body)(const payload_t &, args_t...)>
+struct service_impl<payload_t (*)(const payload_t &, args_t...), body> : 
+	service_args<args_t...> {
+
+	typedef payload_t result_type;
+	typedef std::tuple<args_t...> args_type;
+
+	static constexpr bool returns_payload = true;
+
+	template<std::size_t... I>
+	static bool call(wire_reader_t &op, const payload_t &in,
+		int32_t &result, payload_t &out, index_sequence<I...>)
+	{
+		args_type args;
+
+		if (!deserialize(op, std::get<I>(args)...))
+			return false;
+		out = body(in, std::get<I>(args)...);
+		result = (int32_t) htonl((uint32_t) out.size());
+
+		return true;
+	}
+
+	/**
+	 * @brief Executes an operation, it is the service_executor of the
+	 * 	  service
+	 */
+
+	static bool execute(wire_reader_t &op, const payload_t &in,
+		int32_t &result, payload_t &out)
+	{
+		return call(op, in, result, out,
+			make_index_sequence<sizeof...(args_t)>());
+	}
+};
+
+/**
+ * @class service_def
+ * @brief Declaration of a service, it is specialized by RSF_SERVICE
+ */
+
+template<service_type_t service>
+struct service_def;
+
+/* Declares the body of a service, its types are taken from the body */
+#define RSF_SERVICE(type, body) \
+	template<> struct service_def<type> : \
+		service_impl<decltype(&body), &body> {}
+
+RSF_SERVICE(INCREMENT, increment);
+RSF_SERVICE(DECREMENT, decrement);
+RSF_SERVICE(MULTIPLY2, multiply2);
+RSF_SERVICE(SUM, sum);
+RSF_SERVICE(AVERAGE, average);
+RSF_SERVICE(INVERT, invert);
+
+template<std::size_t... I>
+inline service_executor get_service_executor(service_type_t service,
+	index_sequence<I...>)
+{
+	static const service_executor executors[] = {
+		&service_def<(service_type_t) I>::execute...
+	};
+
+	return executors[service];
+}
+
+/**
+ * @brief Gets the executor of a service, the table is built at compile
+ * 	  time from the declarations
+ * @param service Service type
+ * @return It returns the executor, NULL if the service is unknown
+ */
+
+inline service_executor get_service_executor(service_type_t service)
+{
+	if ((uint32_t) service >= NUM_SERVICES)
+		return NULL;
+
+	return get_service_executor(service,
+		make_index_sequence<NUM_SERVICES>());
+}
+
+template<std::size_t... I>
+inline bool service_returns_payload(service_type_t service,
+	index_sequence<I...>)
+{
+	static const bool returns_payload[] = {
+		service_def<(service_type_t) I>::returns_payload...
+	};
+
+	return returns_payload[service];
+}
+
+/**
+ * @brief Checks if a service returns a payload, its replies carry the 
+ * 	  digest of the payload and they are voted on it
+ * @param service Service type
+ * @return It returns true if the service returns a payload
+ */
+
+inline bool service_returns_payload(service_type_t service)
+{
+	if ((uint32_t) service >= NUM_SERVICES)
+		return false;
+
+	return service_returns_payload(service,
+		make_index_sequence<NUM_SERVICES>());
+}
+
+template<std::size_t... I>
+inline bool service_check_op(service_type_t service, wire_reader_t &op,
+	index_sequence<I...>)
+{
+	static bool (* const checks[])(wire_reader_t &) = {
+		&service_def<(service_type_t) I>::check...
+	};
+
+	return checks[service](op);
+}
+
+/**
+ * @brief Checks that the operations of a request match the parameters of 
+ * 	  its service, so that every copy can execute them. The operations 
+ * 	  must have been checked by wire_check_ops.
+ * @param service Service type
+ * @param data First operation
+ * @param size Length of the operations
+ * @param num_ops Number of operations
+ * @return It returns false if an operation doesn't match or the service is
+ * 	   unknown
+ */
+
+inline bool service_check_ops(service_type_t service, const uint8_t *data,
+	size_t size, uint32_t num_ops)
+{
+	wire_reader_t ops = {data, data + size}, op;
+
+	if ((uint32_t) service >= NUM_SERVICES)
+		return false;
+	for (uint32_t i = 0; i < num_ops; i++)
+		if (!wire_next_op(ops, op) || !service_check_op(service, op,
+			make_index_sequence<NUM_SERVICES>()))
+			return false;
+
+	return true;
+}
+
+#endif /* INCLUDE_SERVICE_REGISTRY_HPP_ */
@@ -0,0 +1,88 @@
+/*
+ * sharded_broker_class.hpp
+ *
+ */
+
+#ifndef INCLUDE_SHARDED_BROKER_CLASS_HPP_
+#define INCLUDE_SHARDED_BROKER_CLASS_HPP_
+
+#include <zmq.hpp>
+#include <string>
+#include <vector>
+#include <thread>
+#include "types.hpp"
+#include "service.hpp"
+#include "broker_class.hpp"
+
+#define FRONT_ROUTER_POLL_INDEX 0
+#define FRONT_REG_POLL_INDEX 1
+#define FRONT_HC_POLL_INDEX 2
+#define FRONT_SHARD_POLL_INDEX 3
+
+/* Dealer ports reserved to each shard */
+#define DEALER_PORTS_PER_SHARD 100
+
+/**
+ * @class RSF_ShardedBroker
+ * @file sharded_broker_class.hpp
+ * @brief Multi-threaded broker. The front end thread owns the client, the
+ * 	  registration and the health checker sockets, while the services 
+ * 	  are partitioned among shards, each one running a RSF_Broker with 
+ * 	  its own dealer sockets, database and timers in a worker thread.
+ * 	  Client requests and registrations are routed to the shard of 
+ * 	  their service and the replies are routed back, over inproc pairs.
+ */
+
+template<uint8_t nmr>
+class RSF_ShardedBroker {
+
+private:
+	/* Number of shards */
+	uint16_t num_shards;
+	/* Sockets for ZMQ communication */
+	zmq::context_t *context;
+	zmq::socket_t *router;
+	zmq::socket_t *reg;
+	zmq::socket_t *hc;
+	/* Inproc sockets towards the shards */
+	std::vector<zmq::socket_t*> shard_front;
+	std::vector<zmq::socket_t*> shard_reg;
+	std::vector<zmq::socket_t*> shard_hc;
+	/* Shards that have not answered the last ping yet */
+	uint16_t pending_pongs;
+	/* Shards and their worker threads */
+	std::vector<RSF_Broker<nmr>*> shards;
+	std::vector<std::thread> workers;
+	/* Poll set */
+	std::vector<zmq::pollitem_t> items;
+	/* Buffer for the frames of a message */
+	std::vector<zmq::message_t> frames;
+	/* Identificator used for logging */
+	std::string my_name;
+
+	/* Gets the shard of a service */
+	uint16_t get_shard(service_type_t service);
+	/* Routes a client request to its shard */
+	void route_request();
+	/* Routes a registration to its shard */
+	void route_registration();
+	/* Sends a message received from a shard to the outside */
+	void route_reply(zmq::socket_t *from, zmq::socket_t *to);
+	/* Function for relaying a ping of the health checker to the shards */
+	void relay_ping();
+	/* Function for collecting the pong of a shard */
+	void collect_pong(uint16_t shard);
+public:
+	RSF_ShardedBroker(uint16_t port_router, uint16_t port_reg,
+		uint16_t num_shards);
+	void enable_cache(service_type_t service, uint32_t size, 
+		uint32_t ttl_ms);
+	void enable_coalescing(service_type_t service);
+	void enable_affinity(service_type_t service);
+	void enable_duplex(service_type_t service);
+	void set_transport(service_type_t service, uint8_t transport);
+	void step();
+	~RSF_ShardedBroker();
+};
+
+#endif /* INCLUDE_SHARDED_BROKER_CLASS_HPP_ */
@@ -0,0 +1,99 @@
+/*
+ * shm_channel_class.hpp
+ *
+ */
+
+#ifndef INCLUDE_SHM_CHANNEL_CLASS_HPP_
+#define INCLUDE_SHM_CHANNEL_CLASS_HPP_
+
+#include <zmq.hpp>
+#include <string>
+#include <vector>
+#include <atomic>
+#include "types.hpp"
+
+/* Bytes of each ring, a frame must fit in half of it */
+#define SHM_RING_SIZE (4 * 1024 * 1024)
+/* A frame is prefixed by its length and its flags, and it is aligned */
+#define SHM_FRAME_HEADER 8
+#define SHM_ALIGN 8
+#define SHM_MORE 1
+/* Length of the marker that sends the reader back to the ring start */
+#define SHM_WRAP 0xFFFFFFFF
+/* Rings of a channel */
+#define SHM_TO_SERVER 0
+#define SHM_TO_BROKER 1
+/* File descriptors handed over to the broker: the segment and the
+ * eventfd of each ring */
+#define SHM_NUM_FDS 3
+/* The broker listens for the handovers of the copies of a service on
+ * this path followed by the backend port */
+#define SHM_SOCKET_PREFIX "/tmp/rsf_shm_"
+
+static_assert(ATOMIC_LONG_LOCK_FREE == 2,
+	"the rings need address free atomics");
+
+/**
+ * @class shm_ring_t
+ * @brief Single producer single consumer ring of frames in shared memory.
+ * 	  The positions grow forever, the offset in the ring is taken
+ * 	  modulo SHM_RING_SIZE.
+ */
+
+struct shm_ring_t {
+	/* Position of the next frame to be read, written by the reader */
+	alignas(64) std::atomic<uint64_t> head;
+	/* Position after the last message written, written by the writer */
+	alignas(64) std::atomic<uint64_t> tail;
+	alignas(64) uint8_t data[SHM_RING_SIZE];
+};
+
+/**
+ * @class shm_segment_t
+ * @brief Shared memory of a channel between the broker and a server copy
+ */
+
+struct shm_segment_t {
+	shm_ring_t rings[2];
+};
+
+/**
+ * @class ShmChannel
+ * @file shm_channel_class.hpp
+ * @brief Channel between the broker and a co-located server copy, made of
+ * 	  two lock-free rings in shared memory. A message is written in a
+ * 	  ring as a whole and its reader is woken up by an eventfd in
+ * 	  semaphore mode, so the eventfd can be polled together with the
+ * 	  ZMQ sockets and it stays readable until every message is read.
+ * 	  The server copy creates the channel and hands the descriptors
+ * 	  over to the broker through a unix socket.
+ */
+
+class ShmChannel {
+
+private:
+	shm_segment_t *segment;
+	/* Descriptors of the segment and of the eventfd of each ring */
+	int32_t fds[SHM_NUM_FDS];
+	/* Ring written and ring read by this side */
+	uint8_t tx;
+	uint8_t rx;
+
+	bool map();
+public:
+	bool create();
+	bool attach(const int32_t *fds);
+	bool handover(const std::string &path, const std::string &identity);
+	bool send(std::vector<zmq::message_t> &frames);
+	bool recv(std::vector<zmq::message_t> &frames);
+	int32_t get_fd();
+
+	ShmChannel();
+	~ShmChannel();
+};
+
+extern int32_t shm_listen(const std::string &path);
+extern bool shm_accept(int32_t listener, std::string &identity,
+	int32_t *fds);
+
+#endif /* INCLUDE_SHM_CHANNEL_CLASS_HPP_ */
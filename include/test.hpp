@@ -14,6 +14,36 @@
 #define SERVER_PONG_PORT 7000
 #define BROKER_PONG_PORT 8000
 
+/* Redundancy of the broker, it selects the instantiation, either 3 or 5 */
 #define NMR 3
 
+/* Number of shards of the broker, 1 for a single threaded broker */
+#define BROKER_SHARDS 1
+
+/* Result cache of the deterministic services, 0 entries to disable it */
+#define CACHE_SIZE 0
+#define CACHE_TTL_MS 10000
+
+/* 1 to coalesce identical pending requests of the deterministic services */
+#define COALESCE_REQUESTS 0
+
+/* 1 to send the requests with the same parameters to the same group of 
+ * copies, for the locality of the caches of the servers */
+#define GROUP_AFFINITY 0
+
+/* 1 to send the requests to 2 copies first, the other copies are asked 
+ * only if the results differ or the 2 copies don't answer in time */
+#define DUPLEX_EXECUTION 0
+
+/* Transport between the broker and the copies: TRANSPORT_TCP, TRANSPORT_IPC
+ * or TRANSPORT_SHM, the last two need the copies on the host of the broker */
+#define BACKEND_TRANSPORT TRANSPORT_TCP
+
+/* 1 to make the server copies poll without blocking, the main thread of 
+ * the copy i is pinned to the core SERVER_BUSY_POLL_CPU + i (-1 to leave it
+ * unpinned). Setting the environment variable RSF_BUSY_POLL_CPU enables it
+ * too, from that core. */
+#define SERVER_BUSY_POLL 0
+#define SERVER_BUSY_POLL_CPU -1
+
 #endif /* INCLUDE_TEST_HPP_ */
\ No newline at end of file
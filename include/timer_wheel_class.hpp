@@ -0,0 +1,96 @@
+/*
+ * timer_wheel_class.hpp
+ *
+ */
+
+#ifndef INCLUDE_TIMER_WHEEL_CLASS_HPP_
+#define INCLUDE_TIMER_WHEEL_CLASS_HPP_
+
+#include <vector>
+#include <time.h>
+#include "types.hpp"
+#include "service.hpp"
+
+/* Resolution of the wheel in milliseconds */
+#define WHEEL_TICK_MS 1
+#define WHEEL_BITS 8
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+/* Three levels cover 2^24 ticks, i.e. more than 4 hours */
+#define WHEEL_LEVELS 3
+#define WHEEL_BITMAP_WORDS (WHEEL_SLOTS / 64)
+#define TIMER_NONE 0xFFFFFFFF
+
+/**
+ * @class timer_expired_t
+ * @brief Expired timer returned to the owner of the wheel
+ */
+
+struct timer_expired_t {
+	/* Service of the request */
+	service_type_t service;
+	/* Identifies the request within the service */
+	uint32_t key;
+};
+
+/**
+ * @class timer_node_t
+ * @brief Node of the wheel, timers are linked in the slot lists by index
+ */
+
+struct timer_node_t {
+	/* Expiration time in ticks */
+	uint64_t expiry;
+	/* Owner data */
+	timer_expired_t data;
+	/* Links in the slot list, or in the free list */
+	uint32_t prev;
+	uint32_t next;
+	/* Level and slot of the list where the node is linked */
+	uint8_t level;
+	uint8_t slot;
+	bool armed;
+};
+
+/**
+ * @class TimerWheel
+ * @file timer_wheel_class.hpp
+ * @brief Hierarchical timer wheel with O(1) insertion and cancellation.
+ * 	  Timers far in the future are kept in the upper levels and cascade
+ * 	  down when the lower level wraps around, so only the expired
+ * 	  timers are visited while advancing.
+ */
+
+class TimerWheel {
+
+private:
+	/* Pool of nodes, a timer is identified by its index in the pool */
+	std::vector<timer_node_t> nodes;
+	/* Head of the free nodes list */
+	uint32_t free_list;
+	/* Heads of the slot lists */
+	uint32_t slots[WHEEL_LEVELS][WHEEL_SLOTS];
+	/* Bitmap of the non empty slots */
+	uint64_t occupied[WHEEL_LEVELS][WHEEL_BITMAP_WORDS];
+	/* Current time in ticks */
+	uint64_t now_tick;
+	/* Number of armed timers */
+	uint32_t armed_timers;
+
+	void link(uint32_t id);
+	void unlink(uint32_t id);
+	void cascade(uint8_t level);
+	int32_t next_occupied(uint8_t level, uint32_t from);
+public:
+	uint32_t add(struct timespec *timeout, timer_expired_t data);
+	void cancel(uint32_t id);
+	void advance(struct timespec *now,
+		std::vector<timer_expired_t> &expired);
+	bool next_expiry(struct timespec &deadline);
+	uint32_t size();
+
+	TimerWheel();
+	~TimerWheel();
+};
+
+#endif /* INCLUDE_TIMER_WHEEL_CLASS_HPP_ */
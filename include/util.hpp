@@ -9,25 +9,55 @@
 #include <zmq.hpp>
 #include <iostream>
 #include <vector>
+#include <memory>
 #include "types.hpp"
 #include "service.hpp"
+#include "communication.hpp"
+#include "logger_class.hpp"
 
-//#define CONSOLE_LOG
-#define ABS_YEAR 1900
 
-
-extern void get_arg(int32_t, char_t **, uint8_t &, uint8_t &, char_t);
+extern void get_arg(int32_t, char_t **, uint8_t &, uint8_t &, char_t,
+	uint8_t * = NULL);
 extern void get_arg(int32_t, char_t **, service_type_t &, char_t);
 
+extern void compute_digest(const void *, size_t, digest_t &);
+
 extern zmq::socket_t* add_socket(zmq::context_t *, std::string, uint16_t, 
 	int32_t, uint8_t);
 
+extern zmq::socket_t* add_socket(zmq::context_t *, std::string, uint16_t, 
+	int32_t, uint8_t, const std::string &);
+
+extern std::string transport_endpoint(uint8_t, std::string, uint16_t);
+
+extern zmq::socket_t* add_endpoint_socket(zmq::context_t *, 
+	const std::string &, int32_t, uint8_t, const std::string &);
+
+extern zmq::socket_t* add_inproc_socket(zmq::context_t *, std::string, 
+	int32_t, uint8_t);
+
 extern void send_multi_msg(zmq::socket_t*, std::vector<zmq::message_t>&);
 
+extern void recv_multi_msg(zmq::socket_t*, std::vector<zmq::message_t>&);
+
+extern void reply_status(zmq::socket_t*, std::vector<zmq::message_t>&,
+	service_status_t, uint32_t);
+
+extern void forward_multi_msg(zmq::socket_t*, std::vector<zmq::message_t>&);
+
+extern void payload_to_frames(const std::shared_ptr<payload_t> &, 
+	std::vector<zmq::message_t>&);
+
+extern void payload_copy_to_frames(const payload_t &, 
+	std::vector<zmq::message_t>&);
+
+extern void frames_to_payload(std::vector<zmq::message_t>&, uint32_t, 
+	payload_t &);
+
 extern zmq::socket_t* add_socket(zmq::context_t *, std::string, uint16_t, 
 	int32_t, uint8_t);
 
-extern void deployment(uint8_t, uint8_t, pid_t *, int32_t *);
+extern void deployment(uint8_t, uint8_t, uint8_t, pid_t *, int32_t *);
 
 extern void time_copy(struct timespec *, const struct timespec *);
 
@@ -37,8 +67,10 @@ extern void time_add_ns(struct timespec *, int64_t);
 
 extern int32_t time_cmp(struct timespec *, struct timespec *t2);
 
-extern void busy_wait(uint32_t );
+extern int64_t time_diff_ns(struct timespec *, struct timespec *);
 
-extern void write_log(std::string, std::string);
+extern int64_t time_to_deadline_ms(struct timespec *, struct timespec *);
+
+extern void busy_wait(uint32_t );
 
 #endif /* INCLUDE_CHECK_UTIL_HPP_ */
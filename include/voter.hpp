@@ -0,0 +1,136 @@
+/*
+ * voter.hpp
+ * Incremental majority voter kept in each request record
+ */
+
+#ifndef INCLUDE_VOTER_HPP_
+#define INCLUDE_VOTER_HPP_
+
+#include "types.hpp"
+#include "communication.hpp"
+
+/**
+ * @brief      It's the outcome of the vote
+ */
+
+enum vote_status_t {
+	/* More results are needed to decide */
+	VOTE_PENDING = 0,
+	/* A value has the majority */
+	VOTE_MAJORITY = 1,
+	/* No value can reach the majority anymore */
+	VOTE_IMPOSSIBLE = 2,
+	/* The copies of a duplex request disagree, the copies held back are 
+	 * needed */
+	VOTE_ESCALATE = 3
+};
+
+/**
+ * @class voter_t
+ * @brief Tally of the results received for an operation. At most nmr 
+ * 	  results are received, so they are kept in a fixed inline array.
+ */
+
+struct voter_t {
+	/* Results received, in order of arrival */
+	int32_t values[MAX_NMR];
+	/* Number of results received */
+	uint8_t received;
+	/* Occurrences of the most voted value */
+	uint8_t max_count;
+	/* Most voted value */
+	int32_t result;
+	vote_status_t status;
+};
+
+/**
+ * @class vote_network
+ * @brief Comparison network unrolled at compile time, it counts the 
+ * 	  occurrences of a value among the first n results without branches
+ */
+
+template<uint8_t n>
+struct vote_network {
+	static inline uint8_t count(const int32_t *values, int32_t value,
+		uint8_t received)
+	{
+		return vote_network<n - 1>::count(values, value, received) +
+			((uint8_t) (n - 1 < received) & 
+			(uint8_t) (values[n - 1] == value));
+	}
+};
+
+template<>
+struct vote_network<0> {
+	static inline uint8_t count(const int32_t *values, int32_t value,
+		uint8_t received)
+	{
+		return 0;
+	}
+};
+
+/**
+ * @brief Resets the tally of a voter
+ * @param v Voter to be reset
+ */
+
+inline void voter_reset(voter_t &v)
+{
+	for (uint8_t i = 0; i < MAX_NMR; i++)
+		v.values[i] = 0;
+	v.received = 0;
+	v.max_count = 0;
+	v.result = 0;
+	v.status = VOTE_PENDING;
+}
+
+/**
+ * @brief Adds a result to the tally and decides as soon as a value has the 
+ * 	  majority or the majority has become impossible
+ * @param v Voter
+ * @param value Result received from a copy
+ * @return It returns the status of the vote
+ */
+
+template<uint8_t nmr>
+inline vote_status_t voter_push(voter_t &v, int32_t value)
+{
+	static_assert(nmr % 2 == 1 && nmr <= MAX_NMR, 
+		"nmr must be odd and not greater than MAX_NMR");
+	const uint8_t majority = nmr / 2 + 1;
+	uint8_t count, better, reached, impossible;
+	int32_t mask;
+
+	if (v.status != VOTE_PENDING || v.received >= nmr)
+		return v.status;
+	
+	v.values[v.received++] = value;
+	count = vote_network<nmr>::count(v.values, value, v.received);
+	
+	/* The count of a value grows only when the value is received, so 
+	 * the most voted value is updated against the current one only */
+	better = count > v.max_count;
+	mask = -(int32_t) better;
+	v.max_count = (uint8_t) ((count & mask) | (v.max_count & ~mask));
+	v.result = (value & mask) | (v.result & ~mask);
+
+	reached = v.max_count >= majority;
+	impossible = v.max_count + (nmr - v.received) < majority;
+	v.status = (vote_status_t) (reached * VOTE_MAJORITY + 
+		impossible * VOTE_IMPOSSIBLE);
+
+	return v.status;
+}
+
+/**
+ * @brief Gets the most voted value
+ * @param v Voter
+ * @return It returns the most voted value, 0 if no result was received
+ */
+
+inline int32_t voter_result(const voter_t &v)
+{
+	return v.result;
+}
+
+#endif /* INCLUDE_VOTER_HPP_ */
@@ -0,0 +1,146 @@
+/*
+ *	worker_pool_class.hpp
+ *
+ */
+
+#ifndef INCLUDE_WORKER_POOL_CLASS_HPP_
+#define INCLUDE_WORKER_POOL_CLASS_HPP_
+
+#include <zmq.hpp>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include "types.hpp"
+#include "communication.hpp"
+#include "service_registry.hpp"
+
+/* Number of workers of a server copy, 0 for one for each core */
+#define WORKER_THREADS 0
+
+/* Simulated workload of a request, the cancellation is checked every
+ * CANCEL_CHECK_MS */
+#define WORKLOAD_MS 500
+#define CANCEL_CHECK_MS 10
+
+/**
+ * @class completion_t
+ * @brief Request elaborated by a worker, it is sent by the main thread
+ */
+
+struct completion_t {
+	uint32_t seq_id;
+	/* Identity of the client in the envelope of the request */
+	std::string client_id;
+	/* Results in network byte order */
+	std::vector<int32_t> results;
+	/* Payload of the result, NULL if there is none */
+	std::shared_ptr<payload_t> payload;
+	/* True if the reply carries the digest of the payload */
+	bool has_digest;
+	digest_t digest;
+	/* True if the request has been cancelled or its parameters don't
+	 * match the service, nothing is sent */
+	bool cancelled;
+};
+
+/**
+ * @class service_thread_t
+ * @brief Request to be elaborated by a worker
+ */
+
+struct service_thread_t {
+	/* Message of the broker, the operations of the batch are read in
+	 * place */
+	std::shared_ptr<zmq::message_t> request;
+	uint32_t num_ops;
+	/* Payload of the request */
+	std::shared_ptr<payload_t> payload;
+	uint32_t seq_id;
+	/* Identity of the client in the envelope of the request */
+	std::string client_id;
+	service_executor service;
+	service_type_t service_type;
+	/* Set by the main thread when the broker cancels the request */
+	std::shared_ptr<std::atomic<bool>> cancelled;
+};
+
+/**
+ * @class completion_node_t
+ * @brief Node of the completion queue
+ */
+
+struct completion_node_t {
+	std::atomic<completion_node_t*> next;
+	completion_t completion;
+};
+
+/**
+ * @class CompletionQueue
+ * @file worker_pool_class.hpp
+ * @brief Lock-free queue of the completions, pushed by the workers and
+ * 	  popped by the main thread only. The last node pushed is the head,
+ * 	  the tail is a stub node whose successor is the next completion to
+ * 	  be popped.
+ */
+
+class CompletionQueue {
+
+private:
+	std::atomic<completion_node_t*> head;
+	/* Used by the consumer only */
+	completion_node_t *tail;
+
+public:
+	void push(completion_t &completion);
+	bool pop(completion_t &completion);
+
+	CompletionQueue();
+	~CompletionQueue();
+};
+
+/**
+ * @class WorkerPool
+ * @file worker_pool_class.hpp
+ * @brief Fixed set of threads elaborating the requests of a server copy.
+ * 	  The results are handed back through the completion queue, so the
+ * 	  sockets are used by the main thread only.
+ */
+
+class WorkerPool {
+
+private:
+	std::vector<std::thread> workers;
+	/* Requests waiting for a worker */
+	std::deque<service_thread_t> jobs;
+	std::mutex mutex;
+	std::condition_variable available;
+	bool stopping;
+	CompletionQueue completions;
+	/* Eventfd written at every completion, it wakes up the main thread */
+	int32_t notify_fd;
+	/* Time spent by the workers on the requests, in microseconds */
+	std::atomic<uint64_t> busy_us;
+	/* Sample of the last utilization computed */
+	uint64_t last_busy_us;
+	struct timespec last_sample;
+
+	void worker();
+public:
+	void submit(service_thread_t &job);
+	bool get_completion(completion_t &completion);
+	int32_t get_fd();
+	void clear_fd();
+	uint32_t get_queue_depth();
+	uint32_t get_workers();
+	double get_utilization();
+
+	WorkerPool(uint32_t num_workers);
+	~WorkerPool();
+};
+
+#endif /* INCLUDE_WORKER_POOL_CLASS_HPP_ */
@@ -0,0 +1,278 @@
+/*
+ * transport_bench.cpp
+ * Benchmark of the transports between the broker and the server copies: a
+ * message is sent to BENCH_COPIES echo copies and the round trip ends when
+ * every copy has answered, as for a request voted by the broker
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <iostream>
+#include <thread>
+#include <algorithm>
+#include <zmq.hpp>
+#include "../../include/types.hpp"
+#include "../../include/util.hpp"
+#include "../../include/communication.hpp"
+#include "../../include/shm_channel_class.hpp"
+
+#define BENCH_COPIES 3
+#define BENCH_PORT 5590
+#define BENCH_ITERATIONS 10000
+#define BENCH_MSG_SIZE 64
+#define BENCH_INPROC "rsf_bench"
+#define BENCH_SHM_PATH "/tmp/rsf_shm_bench"
+
+/**
+ * @brief Gets the elapsed time in microseconds
+ */
+
+static double elapsed_us(const struct timespec &start,
+	const struct timespec &end)
+{
+	return (end.tv_sec - start.tv_sec) * 1e6 +
+		(end.tv_nsec - start.tv_nsec) / 1e3;
+}
+
+/**
+ * @brief Prints the statistics of the round trips of a transport
+ * @param name Name of the transport
+ * @param samples Round trips in microseconds
+ */
+
+static void print_stats(const std::string &name, std::vector<double> &samples)
+{
+	double sum = 0;
+
+	if (samples.empty())
+		return;
+	std::sort(samples.begin(), samples.end());
+	for (uint32_t i = 0; i < samples.size(); i++)
+		sum += samples[i];
+	printf("%-8s avg %8.2f us  p50 %8.2f us  p99 %8.2f us\n", name.c_str(),
+		sum / samples.size(), samples[samples.size() / 2],
+		samples[samples.size() * 99 / 100]);
+}
+
+/**
+ * @brief Echo copy on a ZMQ transport, an empty message stops it
+ */
+
+static void zmq_copy(zmq::context_t *ctx, std::string endpoint,
+	std::string identity)
+{
+	zmq::socket_t *skt;
+	std::vector<zmq::message_t> frames;
+
+	skt = add_endpoint_socket(ctx, endpoint, ZMQ_DEALER, CONNECT, identity);
+	for (;;) {
+		recv_multi_msg(skt, frames);
+		if (frames.back().size() == 0)
+			break;
+		forward_multi_msg(skt, frames);
+	}
+	delete skt;
+}
+
+/**
+ * @brief Echo copy on a shared memory channel, an empty message stops it
+ */
+
+static void shm_copy(std::string identity)
+{
+	ShmChannel channel;
+	std::vector<zmq::message_t> frames;
+	zmq::pollitem_t item;
+
+	if (!channel.create() || !channel.handover(BENCH_SHM_PATH, identity))
+		return;
+	item = {NULL, channel.get_fd(), ZMQ_POLLIN, 0};
+	for (;;) {
+		zmq::poll(&item, 1, -1);
+		if (!channel.recv(frames))
+			continue;
+		if (frames.back().size() == 0)
+			break;
+		channel.send(frames);
+	}
+}
+
+/**
+ * @brief Sends a message to a copy through the ROUTER socket
+ */
+
+static void send_copy(zmq::socket_t *router, uint8_t copy,
+	const std::string &data)
+{
+	std::vector<zmq::message_t> frames;
+	std::string identity = "R" + std::to_string((int32_t) copy);
+
+	frames.push_back(zmq::message_t(identity.data(), identity.size()));
+	frames.push_back(zmq::message_t(data.data(), data.size()));
+	forward_multi_msg(router, frames);
+}
+
+/**
+ * @brief Measures the fan-out round trips on a ZMQ transport, the copies
+ * 	  are threads of this process
+ * @param ctx ZMQ context, shared with the copies for inproc
+ * @param bind Endpoint of the ROUTER socket
+ * @param connect Endpoint of the copies
+ * @param iterations Number of round trips
+ * @param size Size of the messages
+ * @return It returns the round trips in microseconds
+ */
+
+static std::vector<double> bench_zmq(zmq::context_t *ctx,
+	const std::string &bind, const std::string &connect,
+	uint32_t iterations, uint32_t size)
+{
+	zmq::socket_t *router;
+	std::vector<std::thread> copies;
+	std::vector<zmq::message_t> frames;
+	std::vector<double> samples;
+	std::string data(size, 'x');
+	struct timespec start, end;
+	uint32_t connected = 0;
+	zmq::pollitem_t item;
+
+	router = add_endpoint_socket(ctx, bind, ZMQ_ROUTER, BIND, "");
+	for (uint8_t j = 0; j < BENCH_COPIES; j++)
+		copies.push_back(std::thread(zmq_copy, ctx, connect,
+			"R" + std::to_string((int32_t) j)));
+
+	/* The messages to a copy that is not connected yet are dropped */
+	while (connected < BENCH_COPIES) {
+		connected = 0;
+		for (uint8_t j = 0; j < BENCH_COPIES; j++)
+			send_copy(router, j, data);
+		usleep(100000);
+		item = {static_cast<void*>(*router), 0, ZMQ_POLLIN, 0};
+		while (zmq::poll(&item, 1, 0) > 0) {
+			recv_multi_msg(router, frames);
+			connected++;
+		}
+	}
+
+	for (uint32_t i = 0; i < iterations; i++) {
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (uint8_t j = 0; j < BENCH_COPIES; j++)
+			send_copy(router, j, data);
+		for (uint8_t j = 0; j < BENCH_COPIES; j++)
+			recv_multi_msg(router, frames);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		samples.push_back(elapsed_us(start, end));
+	}
+
+	for (uint8_t j = 0; j < BENCH_COPIES; j++)
+		send_copy(router, j, "");
+	for (uint8_t j = 0; j < BENCH_COPIES; j++)
+		copies[j].join();
+	delete router;
+
+	return samples;
+}
+
+/**
+ * @brief Measures the fan-out round trips on the shared memory channels
+ * @param iterations Number of round trips
+ * @param size Size of the messages
+ * @return It returns the round trips in microseconds
+ */
+
+static std::vector<double> bench_shm(uint32_t iterations, uint32_t size)
+{
+	ShmChannel channels[BENCH_COPIES];
+	std::vector<std::thread> copies;
+	std::vector<zmq::message_t> frames;
+	std::vector<zmq::pollitem_t> items;
+	std::vector<double> samples;
+	std::string data(size, 'x'), identity;
+	struct timespec start, end;
+	int32_t listener, fds[SHM_NUM_FDS];
+	uint32_t attached = 0, received;
+
+	listener = shm_listen(BENCH_SHM_PATH);
+	if (listener < 0)
+		return samples;
+	for (uint8_t j = 0; j < BENCH_COPIES; j++)
+		copies.push_back(std::thread(shm_copy,
+			"R" + std::to_string((int32_t) j)));
+	while (attached < BENCH_COPIES) {
+		if (!shm_accept(listener, identity, fds)) {
+			usleep(1000);
+			continue;
+		}
+		channels[identity[1] - '0'].attach(fds);
+		attached++;
+	}
+	close(listener);
+	unlink(BENCH_SHM_PATH);
+	for (uint8_t j = 0; j < BENCH_COPIES; j++)
+		items.push_back({NULL, channels[j].get_fd(), ZMQ_POLLIN, 0});
+
+	for (uint32_t i = 0; i < iterations; i++) {
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (uint8_t j = 0; j < BENCH_COPIES; j++) {
+			frames.clear();
+			frames.push_back(zmq::message_t(data.data(), size));
+			channels[j].send(frames);
+		}
+		for (received = 0; received < BENCH_COPIES;) {
+			zmq::poll(items, -1);
+			for (uint8_t j = 0; j < BENCH_COPIES; j++)
+				if ((items[j].revents & ZMQ_POLLIN) &&
+					channels[j].recv(frames))
+					received++;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		samples.push_back(elapsed_us(start, end));
+	}
+
+	for (uint8_t j = 0; j < BENCH_COPIES; j++) {
+		frames.clear();
+		frames.push_back(zmq::message_t(EMPTY_MSG, 0));
+		channels[j].send(frames);
+	}
+	for (uint8_t j = 0; j < BENCH_COPIES; j++)
+		copies[j].join();
+
+	return samples;
+}
+
+int32_t main(int32_t argc, char_t* argv[])
+{
+	uint32_t iterations = BENCH_ITERATIONS, size = BENCH_MSG_SIZE;
+	zmq::context_t ctx(1);
+	std::vector<double> samples;
+
+	/* Parsing the arguments */
+	if (argc > 1)
+		iterations = atoi(argv[1]);
+	if (argc > 2)
+		size = atoi(argv[2]);
+	if (iterations == 0 || size == 0 || size > SHM_RING_SIZE / 4) {
+		std::cerr << "Usage: " << argv[0] << " [iterations] [size]"
+			<< std::endl;
+		exit(EXIT_FAILURE);
+	}
+	printf("%u round trips of %u bytes to %d copies\n", iterations, size,
+		BENCH_COPIES);
+
+	samples = bench_zmq(&ctx, transport_endpoint(TRANSPORT_TCP,
+		ANY_ADDRESS, BENCH_PORT), transport_endpoint(TRANSPORT_TCP,
+		LOCALHOST, BENCH_PORT), iterations, size);
+	print_stats("tcp", samples);
+	samples = bench_zmq(&ctx, transport_endpoint(TRANSPORT_IPC,
+		ANY_ADDRESS, BENCH_PORT), transport_endpoint(TRANSPORT_IPC,
+		ANY_ADDRESS, BENCH_PORT), iterations, size);
+	print_stats("ipc", samples);
+	samples = bench_zmq(&ctx, INPROC_PROTOCOL BENCH_INPROC,
+		INPROC_PROTOCOL BENCH_INPROC, iterations, size);
+	print_stats("inproc", samples);
+	samples = bench_shm(iterations, size);
+	print_stats("shm", samples);
+
+	return EXIT_SUCCESS;
+}
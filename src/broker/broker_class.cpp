@@ -14,17 +14,16 @@
 /**
  * @brief Broker constructor that initializes alle the private data and
  * 	  claims memory for ZPQ sockets. Then it connects to the socket.
- * @param nmr Redundancy for the voter
  * @param port_router It is the port for client communication
  * @param port_reg It is the port for the server registration
  * 
  */
 
-RSF_Broker::RSF_Broker(uint8_t nmr, uint16_t port_router, uint16_t port_reg) 
+template<uint8_t nmr>
+RSF_Broker<nmr>::RSF_Broker(uint16_t port_router, uint16_t port_reg) 
 {	
 	int32_t opt;
 
-	this->nmr = nmr;
 	this->port_router = port_router;
 	this->port_reg = port_reg;
 	this->available_dealer_port = DEALER_START_PORT;
@@ -57,40 +56,97 @@ RSF_Broker::RSF_Broker(uint8_t nmr, uint16_t port_router, uint16_t port_reg)
 	items.push_back(tmp);
 	tmp = {static_cast<void*>(*hc), 0, ZMQ_POLLIN, 0};
 	items.push_back(tmp);
+	backend_poll_index = BACKEND_POLL_INDEX;
+	own_context = true;
 
 	/* Creating a Service Database*/
-	db = new ServiceDatabase(nmr);
+	db = new ServiceDatabase<nmr>();
 
 	my_name = "Broker";
 }
 
+/**
+ * @brief Shard constructor, the client requests, the registrations and 
+ * 	  the pings are received from the front end of a RSF_ShardedBroker.
+ * @param context Context shared with the front end
+ * @param shard Index of the shard
+ * @param dealer_port First port for the backend sockets of the shard
+ * 
+ */
 
+template<uint8_t nmr>
+RSF_Broker<nmr>::RSF_Broker(zmq::context_t *context, uint16_t shard, 
+	uint16_t dealer_port) 
+{
+	this->port_router = 0;
+	this->port_reg = 0;
+	this->available_dealer_port = dealer_port;
+	this->context = context;
+	own_context = false;
+
+	/* The front end has already bound the inproc endpoints */
+	router = add_inproc_socket(context, SHARD_FRONT_ENDPOINT + 
+		std::to_string(shard), ZMQ_PAIR, CONNECT);
+	reg = add_inproc_socket(context, SHARD_REG_ENDPOINT + 
+		std::to_string(shard), ZMQ_PAIR, CONNECT);
+	/* The pings of the health checker are relayed by the front end, so
+	 * the broker is alive only if every shard answers */
+	hc = add_inproc_socket(context, SHARD_HC_ENDPOINT + 
+		std::to_string(shard), ZMQ_PAIR, CONNECT);
+	/* Initialize the poll set */
+	zmq::pollitem_t tmp = {static_cast<void*>(*router), 0, ZMQ_POLLIN, 0};
+	items.push_back(tmp);
+	tmp = {static_cast<void*>(*reg), 0, ZMQ_POLLIN, 0};
+	items.push_back(tmp);
+	tmp = {static_cast<void*>(*hc), 0, ZMQ_POLLIN, 0};
+	items.push_back(tmp);
+	backend_poll_index = BACKEND_POLL_INDEX;
+
+	/* Creating a Service Database*/
+	db = new ServiceDatabase<nmr>();
+
+	my_name = "Broker_Shard" + std::to_string(shard);
+}
 
 /**
  * @brief      Destroys the object.
  */
 
-RSF_Broker::~RSF_Broker()
+template<uint8_t nmr>
+RSF_Broker<nmr>::~RSF_Broker()
 {
+	for (uint32_t i = 0; i < backend.size(); i++)
+		delete backend[i];
+	for (uint32_t i = 0; i < shm_endpoints.size(); i++) {
+		if (shm_endpoints[i].copy == SHM_LISTENER)
+			close(shm_endpoints[i].fd);
+		else
+			delete db->get_record(shm_endpoints[i].service)->
+				replicas[shm_endpoints[i].copy].channel;
+	}
 	delete router;
 	delete reg;
+	delete hc;
 	delete db;
-	delete context;
+	if (own_context)
+		delete context;
 }
 
 /**
  * @brief      step function
  */
 
-void RSF_Broker::step()
+template<uint8_t nmr>
+void RSF_Broker<nmr>::step()
 {
 	for (;;) {
-		zmq::poll(items, 50);
+		zmq::poll(items, next_timer_expiry());
 		clock_gettime(CLOCK_MONOTONIC, &now);
 		
 		/* Check the ping from the health checker*/
 		if (items[HC_POLL_INDEX].revents & ZMQ_POLLIN) {
-			write_log(my_name, "Received ping from HC");
+			WRITE_LOG(LOG_LEVEL_DEBUG, my_name, 
+				"Received ping from HC");
 			pong_health_checker();	
 		}
 		/* Check for a registration request */
@@ -101,96 +157,390 @@ void RSF_Broker::step()
 		if (items[ROUTER_POLL_INDEX].revents & ZMQ_POLLIN) 
 			get_request();		
 		
-		/* Check for messages on the DEALER sockets */
-		for (uint32_t i = 0; i < dealer.size(); i++) 
-			if (items[i + DEALER_POLL_INDEX].revents & 
+		/* Check for messages on the backend sockets */
+		for (uint32_t i = 0; i < backend.size(); i++) 
+			if (items[i + backend_poll_index].revents & 
 				ZMQ_POLLIN) 
 				get_response(i);	
+
+		/* Check for messages on the shared memory channels */
+		for (uint32_t i = 0; i < shm_endpoints.size(); i++)
+			if (items[i + backend_poll_index + backend.size()].
+				revents & ZMQ_POLLIN)
+				get_shm_message(i);
 		
+		fire_timers();
+	}
+}
+
+/**
+ * @brief      Computes how long the poll can block before a timer is due
+ *
+ * @return     It returns the poll timeout in milliseconds, -1 if there 
+ * 		are no timers armed
+ */
+
+template<uint8_t nmr>
+int64_t RSF_Broker<nmr>::next_timer_expiry()
+{
+	bool armed = !timeout.empty();
+	struct timespec deadline;
+
+	if (armed)
+		time_copy(&deadline, &hb_deadline);
+	
+	struct timespec req_deadline;
+	if (db->get_next_request_timeout(req_deadline) && (!armed || 
+		time_cmp(&req_deadline, &deadline) < 0)) {
+		time_copy(&deadline, &req_deadline);
+		armed = true;
+	}
+	
+	if (!armed)
+		return -1;
+	
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	
+	return time_to_deadline_ms(&now, &deadline);
+}
+
+/**
+ * @brief      Fires the timers whose deadline is elapsed
+ */
+
+template<uint8_t nmr>
+void RSF_Broker<nmr>::fire_timers()
+{
+	struct timespec req_deadline;
+
+	if (!timeout.empty() && time_cmp(&now, &hb_deadline) >= 0) {
+		/* Some deadlines may have been postponed, so the earliest
+		 * one is computed again while scanning */
+		bool first = true;
 		for (uint32_t i = 0; i < timeout.size(); i++) {
-			if (time_cmp(&now, &timeout[i]) == 1) {
-				write_log(my_name, "Heartbeat Timeout expired");
-				db->check_pong(available_services[i]);
-				ping_server(i, available_services[i]);
+			if (time_cmp(&now, &timeout[i]) >= 0) {
+				WRITE_LOG(LOG_LEVEL_DEBUG, my_name, 
+					"Heartbeat Timeout expired");
+				db->check_pong(db->get_record(
+					available_services[i]));
+				ping_server(available_services[i]);
 				update_timeout(available_services[i]);
 			}
+			if (first || time_cmp(&timeout[i], &hb_deadline) < 0) {
+				time_copy(&hb_deadline, &timeout[i]);
+				first = false;
+			}
 		}
-		check_pending_requests();
 	}
+
+	if (db->get_next_request_timeout(req_deadline) && 
+		time_cmp(&now, &req_deadline) >= 0)
+		check_pending_requests();
 }
 
 /**
- * @brief      Adds a dealer.
+ * @brief      Adds the backend ROUTER socket of a service, the server 
+ * 		copies connect to it with their identity. With the shared 
+ * 		memory transport the handovers of the channels of the copies 
+ * 		are received too.
  *
- * @param[in]  dealer_port  The dealer port
+ * @param[in]  dealer_port  The backend port
+ * @param      record       The record of the service
  */
 
-void RSF_Broker::add_dealer(uint16_t dealer_port)
+template<uint8_t nmr>
+void RSF_Broker<nmr>::add_backend(uint16_t dealer_port, 
+	service_record<nmr> *record)
 {	
+	int32_t opt, listener;
 	zmq::pollitem_t item;
 
-	dealer.push_back(add_socket(context, ANY_ADDRESS, dealer_port, 
-		ZMQ_DEALER, BIND));
-	
-	item = {static_cast<void*>(*dealer.back()), 0, ZMQ_POLLIN, 0};
+	backend.push_back(add_endpoint_socket(context, transport_endpoint(
+		record->transport, ANY_ADDRESS, dealer_port), ZMQ_ROUTER, BIND,
+		""));
+	/* A restarted copy takes over the identity of its old connection */
+	opt = 1;
+	backend.back()->setsockopt(ZMQ_ROUTER_HANDOVER, &opt, 
+		sizeof(int32_t));
 	
+	/* The backend sockets come before the shared memory descriptors */
+	item = {static_cast<void*>(*backend.back()), 0, ZMQ_POLLIN, 0};
+	items.insert(items.begin() + backend_poll_index + backend.size() - 1,
+		item);
+
+	if (record->transport == TRANSPORT_SHM) {
+		listener = shm_listen(SHM_SOCKET_PREFIX + 
+			std::to_string(dealer_port));
+		if (listener >= 0)
+			add_shm_endpoint(record->service, SHM_LISTENER, 
+				listener);
+	}
+}
+
+/**
+ * @brief      Adds a descriptor of the shared memory transport to the poll 
+ * 		set
+ *
+ * @param[in]  service  The service
+ * @param[in]  copy     The copy of the channel, SHM_LISTENER for the 
+ * 			listener of the handovers
+ * @param[in]  fd       The descriptor
+ */
+
+template<uint8_t nmr>
+void RSF_Broker<nmr>::add_shm_endpoint(service_type_t service, int8_t copy,
+	int32_t fd)
+{
+	shm_endpoint_t endpoint = {service, copy, fd};
+	zmq::pollitem_t item = {NULL, fd, ZMQ_POLLIN, 0};
+
+	shm_endpoints.push_back(endpoint);
 	items.push_back(item);
 }
 
+/**
+ * @brief      Attaches the channel handed over by a copy, the channel of a
+ * 		restarted copy replaces the old one
+ *
+ * @param[in]  listener  The listener of the handovers
+ */
+
+template<uint8_t nmr>
+void RSF_Broker<nmr>::attach_channel(const shm_endpoint_t &listener)
+{
+	service_record<nmr> *record = db->get_record(listener.service);
+	std::string identity;
+	int32_t fds[SHM_NUM_FDS];
+	ShmChannel *channel;
+	int8_t copy = -1;
+
+	if (!shm_accept(listener.fd, identity, fds))
+		return;
+	for (uint8_t j = 0; j < MAX_REPLICAS; j++)
+		if ((record->registered_mask & (1U << j)) && 
+			identity == record->replicas[j].identity)
+			copy = j;
+	channel = new ShmChannel();
+	if (copy < 0 || !channel->attach(fds)) {
+		/* The channel closes the descriptors */
+		delete channel;
+		return;
+	}
+
+	WRITE_LOG(LOG_LEVEL_INFO, my_name, "Server" + 
+		std::to_string((int32_t) copy) + " attached in shared memory");
+	detach_channel(record, copy);
+	record->replicas[copy].channel = channel;
+	add_shm_endpoint(record->service, copy, channel->get_fd());
+}
+
+/**
+ * @brief      Releases the channel of a copy and removes its descriptor
+ * 		from the poll set, the messages go through the backend socket
+ * 		until the copy hands over a new channel
+ *
+ * @param      record  The record of the service
+ * @param[in]  copy    The copy
+ */
+
+template<uint8_t nmr>
+void RSF_Broker<nmr>::detach_channel(service_record<nmr> *record, 
+	uint8_t copy)
+{
+	if (record->replicas[copy].channel == NULL)
+		return;
+	delete record->replicas[copy].channel;
+	record->replicas[copy].channel = NULL;
+	for (uint32_t i = 0; i < shm_endpoints.size(); i++) {
+		if (shm_endpoints[i].service != record->service ||
+			shm_endpoints[i].copy != copy)
+			continue;
+		shm_endpoints.erase(shm_endpoints.begin() + i);
+		items.erase(items.begin() + i + backend_poll_index + 
+			backend.size());
+		return;
+	}
+}
+
+/**
+ * @brief      Gets a message from a descriptor of the shared memory 
+ * 		transport, either a handover or the reply of a copy
+ *
+ * @param[in]  index  The index of the descriptor
+ */
+
+template<uint8_t nmr>
+void RSF_Broker<nmr>::get_shm_message(uint32_t index)
+{
+	shm_endpoint_t endpoint = shm_endpoints[index];
+	std::vector<zmq::message_t> buffer_in;
+
+	if (endpoint.copy == SHM_LISTENER) {
+		attach_channel(endpoint);
+		return;
+	}
+	if (db->get_record(endpoint.service)->replicas[endpoint.copy].
+		channel->recv(buffer_in))
+		handle_reply(buffer_in);
+}
+
+/**
+ * @brief      Sends a message to a set of server copies of a service, 
+ * 		addressing each one by its identity. The messages to a copy 
+ * 		that is not connected are dropped.
+ *
+ * @param      record  The record of the service
+ * @param      copies  The bitmask of the copies
+ * @param      buffer  The frames of the message
+ */
+
+template<uint8_t nmr>
+void RSF_Broker<nmr>::send_to_copies(service_record<nmr> *record,
+	uint32_t copies, std::vector<zmq::message_t> &buffer)
+{
+	zmq::socket_t *skt = backend[record->dealer_skt_index];
+	zmq::message_t identity;
+
+	for (uint8_t j = 0; j < MAX_REPLICAS; j++) {
+		if (!(copies & (1U << j)))
+			continue;
+		/* A co-located copy receives the message in shared memory,
+		 * through the socket if the ring is full or the message is
+		 * too large for it */
+		if (record->replicas[j].channel != NULL &&
+			record->replicas[j].channel->send(buffer))
+			continue;
+		identity.rebuild(record->replicas[j].identity, strnlen(
+			record->replicas[j].identity, MAX_LENGTH_REPLICA_ID));
+		skt->send(identity, ZMQ_SNDMORE | ZMQ_DONTWAIT);
+		send_multi_msg(skt, buffer);
+	}
+}
+
 
 /**
  * @brief      Gets the request from a client 
  */
  
-void RSF_Broker::get_request()
+template<uint8_t nmr>
+void RSF_Broker<nmr>::get_request()
 {	
-	int32_t ret;
+	uint32_t num_ops, ops_size, dispatched, reserve;
+	uint8_t group;
+	service_type_t service;
 	request_module request;
-	response_module response;
 	request_record_t request_record;
-	uint8_t num_copies_reliable;
-	service_module sm;
+	service_record<nmr> *record;
+	const std::vector<int32_t> *cached;
 	std::vector<zmq::message_t> buffer_in(NUM_FRAMES);
+	bool payload;
 
-	/* Receive multiple messages,
-	 * one frame at a time */
-	for (uint8_t i = 0; i < ENVELOPE; i++) {
-		router->recv(&buffer_in[i]);
-		if (i == ID_FRAME) {
-			/* We get the client id and we add a request record */
-			uint8_t *p = (uint8_t *) buffer_in[i].data();
-			p++;
-			request_record.client_id = *((uint32_t *) p);
-		}
+	/* Receive the envelope, the data frame and the frames of the 
+	 * payload if any */
+	recv_multi_msg(router, buffer_in);
+	if (buffer_in.size() < NUM_FRAMES) {
+		WRITE_LOG(LOG_LEVEL_WARNING, my_name, "Malformed request");
+		reply_status(router, buffer_in, SERVICE_MALFORMED, 0);
+		return;
 	}
+	payload = buffer_in.size() > NUM_FRAMES;
+	/* We get the client identity and we add a request record */
+	request_record.client_id.assign(static_cast<char_t*> 
+		(buffer_in[ID_FRAME].data()), buffer_in[ID_FRAME].size());
 
+	if (buffer_in[DATA_FRAME].size() < sizeof(request_module)) {
+		WRITE_LOG(LOG_LEVEL_WARNING, my_name, "Malformed request");
+		reply_status(router, buffer_in, SERVICE_MALFORMED, 0);
+		return;
+	}
 	request = *(static_cast<request_module*> (buffer_in[DATA_FRAME].data()));
-	request.service = (service_type_t) ntohl((uint32_t) request.service);
-	ret = db->find_registration(request.service);
-	if (ret == -1) {
+	service = (service_type_t) ntohl(request.service);
+	num_ops = ntohl(request.num_ops);
+	request_record.digest_voting = service_returns_payload(service);
+	ops_size = buffer_in[DATA_FRAME].size() - sizeof(request_module);
+	/* The operations are checked once, then they are forwarded as they 
+	 * are */
+	if (request.version != WIRE_VERSION || num_ops == 0 || 
+		num_ops > MAX_BATCH_OPS || ((payload || 
+		request_record.digest_voting) && num_ops != 1) || 
+		!wire_check_ops(
+		module_params<request_module>(buffer_in[DATA_FRAME].data()),
+		ops_size, num_ops)) {
+		WRITE_LOG(LOG_LEVEL_WARNING, my_name, "Malformed request");
+		reply_status(router, buffer_in, SERVICE_MALFORMED,
+			ntohl(request.request_id));
+		return;
+	}
+	request_record.request_id = ntohl(request.request_id);
+	request_record.num_ops = num_ops;
+	record = db->get_record(service);
+	if (record == NULL || !record->ready) {
 		/* Service not available */
-		response.service_status = (service_status_t) htonl((uint32_t)
-			SERVICE_NOT_AVAILABLE);
-		buffer_in[DATA_FRAME].rebuild((void*) &response,
-			sizeof(response_module));
-		send_multi_msg(router, buffer_in);
+		reply_status(router, buffer_in, SERVICE_NOT_AVAILABLE,
+			request_record.request_id);
+
+	} else if (!service_check_ops(service, 
+		module_params<request_module>(buffer_in[DATA_FRAME].data()),
+		ops_size, num_ops)) {
+		/* The copies can't execute the operations, the parameters
+		 * don't match the signature of the service */
+		WRITE_LOG(LOG_LEVEL_WARNING, my_name, "Malformed request");
+		reply_status(router, buffer_in, SERVICE_MALFORMED,
+			request_record.request_id);
 
 	} else {
-		/* Service available */
-		sm.heartbeat = false;
-		sm.seq_id = htonl(db->get_request_id(request.service));
-		memcpy(&sm.parameters, request.parameters,
-			sizeof(request.parameters));
-		buffer_in[DATA_FRAME].rebuild((void*) &sm,
-			sizeof(service_module));
-		num_copies_reliable = db->get_reliable_copies(request.service);
-		/* Forwarding the parameter */
-		for (uint8_t j = 0; j < num_copies_reliable; j++)
-			send_multi_msg(dealer[ret], buffer_in);
+		/* Requests with a payload are neither cached nor coalesced,
+		 * the key would be as large as the payload, and neither are
+		 * the results with a payload */
+		if (!payload && !request_record.digest_voting && 
+			(record->cache.enabled() || record->coalescing || 
+			record->affinity))
+			request_record.params_key.assign(
+				reinterpret_cast<char_t*>(
+				module_params<request_module>(
+				buffer_in[DATA_FRAME].data())), ops_size);
+		if (record->cache.enabled()) {
+			cached = record->cache.lookup(request_record.params_key);
+			/* The client is answered without asking the servers */
+			if (cached != NULL) {
+				reply_cached(buffer_in, 
+					request_record.request_id, cached);
+				return;
+			}
+		}
+		/* The request waits for the response of an identical one */
+		if (db->coalesce_request(record, request_record.params_key,
+			request_record.client_id, request_record.request_id))
+			return;
+		/* Service available, the whole batch is forwarded with a
+		 * single message for each copy */
+		zmq::message_t data(sizeof(service_module) + ops_size);
+		request_record.seq_id = record->seq_id_request++;
+		init_service_module(static_cast<service_module*> (data.data()),
+			SM_REQUEST, request_record.seq_id, num_ops);
+		memcpy(module_params<service_module>(data.data()), 
+			module_params<request_module>(
+			buffer_in[DATA_FRAME].data()), ops_size);
+		buffer_in[DATA_FRAME].move(&data);
+		/* Forwarding the parameter to the fastest copies of a 
+		 * group, the frames of the payload are shared by the 
+		 * messages of the copies and they are never copied */
+		dispatched = db->select_copies(record, 
+			request_record.params_key, group, reserve);
+		send_to_copies(record, dispatched, buffer_in);
+		/* In duplex mode the frames are kept for the copies held 
+		 * back, they share the data with the sent ones */
+		if (reserve != 0) {
+			request_record.held = std::make_shared<
+				std::vector<zmq::message_t>>(buffer_in.size());
+			for (uint32_t i = 0; i < buffer_in.size(); i++)
+				(*request_record.held)[i].copy(&buffer_in[i]);
+		}
 		/* Saving the request in the db */
-		db->push_request(&request_record, request.service);
+		db->push_request(record, &request_record, dispatched, reserve,
+			group);
 		/* Postponing timeout */
-		update_timeout(request.service);
+		update_timeout(service);
 	}
 }
 
@@ -198,7 +548,8 @@ void RSF_Broker::get_request()
  * @brief      Gets the registration from a server.
  */
 
-void RSF_Broker::get_registration()
+template<uint8_t nmr>
+void RSF_Broker<nmr>::get_registration()
 {	
 	int32_t more;
 	size_t more_size;
@@ -224,6 +575,17 @@ void RSF_Broker::get_registration()
 			uint16_t ret = 
 			db->push_registration(&rm, available_dealer_port, 
 				ready);
+			/* The backend of a new service is bound at the first
+			 * registration, so it has the index of the service */
+			service_record<nmr> *record = db->get_record(
+				rm.service);
+			if (record != NULL && 
+				record->dealer_skt_index == backend.size())
+				add_backend(ret, record);
+			/* A copy that registers again hands over a new 
+			 * channel, the old one is not used anymore */
+			if (record != NULL && ret != REG_FAIL)
+				detach_channel(record, rm.id);
 			
 			for (uint32_t i = 0; i < available_services.size(); i++)
 				if (available_services[i] == rm.service)
@@ -232,20 +594,25 @@ void RSF_Broker::get_registration()
 			if (ready && !already_registered) {
 				/* Make the service available */
 				available_services.push_back(rm.service);
-				/* Add a dealer port */
-				add_dealer(ret);
 				/* Setting the timeout for the copies */
 				struct timespec timeout_tmp;
 				clock_gettime(CLOCK_MONOTONIC, &timeout_tmp);
 				time_add_ms(&timeout_tmp, HEARTBEAT_INTERVAL);
 				timeout.push_back(timeout_tmp);
+				if (timeout.size() == 1 || time_cmp(
+					&timeout_tmp, &hb_deadline) < 0)
+					time_copy(&hb_deadline, &timeout_tmp);
 			}
 			db->print_htable();
-			ret = htons(ret);
-			/* Sending back the dealer port */
-			zmq::message_t reply(sizeof(ret));
+			/* Sending back the backend port and its transport */
+			registration_reply_t rr;
+			rr.port = htons(ret);
+			rr.transport = record != NULL ? record->transport : 
+				TRANSPORT_TCP;
+			rr.reserved = 0;
+			zmq::message_t reply(sizeof(rr));
 			memcpy(reply.data(), 
-				(void *) &ret, sizeof(ret));
+				(void *) &rr, sizeof(rr));
 			reg->send(reply, 0);
 		}
 	}
@@ -255,163 +622,338 @@ void RSF_Broker::get_registration()
 /**
  * @brief      Gets the response from a server
  *
- * @param[in]  dealer_index  The dealer index
- * @param      num_replies   the replies number for the service
- * @param      dealer_in     The dealer buffer
+ * @param[in]  backend_index  The backend index
  */
 
-void RSF_Broker::get_response(uint32_t dealer_index)
+template<uint8_t nmr>
+void RSF_Broker<nmr>::get_response(uint32_t backend_index)
 {	
-	int32_t num_copies, ret, result;
-	uint32_t i = 0;
-	server_reply_t server_reply;
-	response_module response;
-	zmq::message_t message;
-	uint32_t client_id;
+	zmq::message_t identity;
 	std::vector<zmq::message_t> buffer_in(NUM_FRAMES);
 
-	/* Receiving all the messages */
+	/* Receiving the identity of the copy, then the reply with the 
+	 * envelope of the client and the frames of the payload, or the 
+	 * pong with an empty envelope */
+	backend[backend_index]->recv(&identity);
+	recv_multi_msg(backend[backend_index], buffer_in);
 
-	for (i = 0; i < ENVELOPE; i++) {
-		dealer[dealer_index]->recv(&buffer_in[i], ZMQ_DONTWAIT);
-		if (i == ID_FRAME) {
-			uint8_t *p = (uint8_t *) buffer_in[i].data();
-			p++;
-			client_id = *((uint32_t *) p);
-		}			
-	}
-	
+	handle_reply(buffer_in);
+}
+
+/**
+ * @brief      Handles the reply or the pong of a server, received from the 
+ * 		backend socket or from the shared memory channel of the copy
+ *
+ * @param      buffer_in  The frames of the message without the identity
+ */
+
+template<uint8_t nmr>
+void RSF_Broker<nmr>::handle_reply(std::vector<zmq::message_t> &buffer_in)
+{
+	uint32_t slot;
+	vote_status_t status;
+	server_reply_t server_reply;
+	std::string client_id;
+	request_record_t *request;
+	service_record<nmr> *record;
+	uint32_t data_frame;
+
+	if (buffer_in.empty())
+		return;
+	data_frame = buffer_in.size() >= NUM_FRAMES ? DATA_FRAME : 
+		buffer_in.size() - 1;
+	if (buffer_in[data_frame].size() < sizeof(server_reply_t))
+		return;
 	server_reply = *(static_cast<server_reply_t*>
-			(buffer_in[DATA_FRAME].data()));
+			(buffer_in[data_frame].data()));
+	if (server_reply.version != WIRE_VERSION)
+		return;
 	/* Handle endianess */
-	server_reply.result = (int32_t) ntohl(server_reply.result);
-	server_reply.service = (service_type_t) ntohl((uint32_t)
-		server_reply.service);
+	server_reply.seq_id = ntohl(server_reply.seq_id);
+	server_reply.num_ops = ntohl(server_reply.num_ops);
+	server_reply.service = ntohl(server_reply.service);
+	record = db->get_record((service_type_t) server_reply.service);
+	if (record == NULL)
+		return;
 	if (server_reply.heartbeat) {
-		write_log(my_name, "Pong from Service " + 
+		WRITE_LOG(LOG_LEVEL_DEBUG, my_name, "Pong from Service " + 
 			std::to_string(server_reply.service) + " Server" +
 			std::to_string((int32_t) server_reply.id));
-		db->register_pong(server_reply.id, server_reply.service);
+		db->register_pong(record, server_reply.id);
 	} else {
-		if (!server_reply.duplicated) {
-			num_copies = db->push_result(&server_reply, client_id);
-			if (num_copies > (nmr / 2)) {
-				ret = vote(db->get_result(server_reply.service, 
-					client_id), result);
-				if (ret >= 0) {
-					/* Replace the data frame with the
-					 * one obtained from the voter.
-					 */
-					response.service_status =
-						(service_status_t) htonl(
-						(uint32_t) SERVICE_AVAILABLE);
-					response.result = (int32_t)
-						htonl(result);
-					buffer_in[DATA_FRAME].rebuild((void*)
-						&response, 
-						sizeof(response_module));
-					send_multi_msg(router, buffer_in);
-					/* Deleting service request */
-					db->delete_request(server_reply.service, 
-						client_id);
-				} else if (num_copies == nmr) {
-					response.service_status =
-						(service_status_t)
-						htonl((uint32_t)
-						SERVICE_NOT_RELIABLE);
-					response.result = (int32_t)
-						htonl(result);
-					buffer_in[DATA_FRAME].rebuild((void*)
-						&response, 
-						sizeof(response_module));
-					send_multi_msg(router, buffer_in);
-					/* Deleting service request */
-					db->delete_request(server_reply.service,
-						client_id);
-					/*Sending not reliable service*/
-				}
+		if (!server_reply.duplicated && 
+			buffer_in.size() >= NUM_FRAMES) {
+			client_id.assign(static_cast<char_t*> (
+				buffer_in[ID_FRAME].data()),
+				buffer_in[ID_FRAME].size());
+			slot = db->find_request(record, client_id,
+				server_reply.seq_id);
+			/* The request has been already answered */
+			if (slot == REQUEST_NOT_FOUND)
+				return;
+			request = db->get_request(record, slot);
+			if (server_reply.num_ops != request->num_ops ||
+				buffer_in[DATA_FRAME].size() != 
+				sizeof(server_reply_t) + request->num_ops * 
+				sizeof(int32_t) + (request->digest_voting ? 
+				DIGEST_SIZE : 0))
+				return;
+			/* The client is answered at the reply that decides 
+			 * the vote of the last operation */
+			status = db->push_result(record, server_reply.id,
+				module_results<server_reply_t>(
+				buffer_in[DATA_FRAME].data()), slot);
+			if (status == VOTE_ESCALATE) {
+				escalate_request(record, slot);
+			} else if (status != VOTE_PENDING) {
+				reply_client(buffer_in, request);
+				/* Only the results voted by a majority are
+				 * reused */
+				if (status == VOTE_MAJORITY)
+					db->cache_result(record, request);
+				/* The answers of the other copies are no 
+				 * longer needed */
+				cancel_copies(record, request);
+				/* Deleting service request */
+				db->delete_request(record, slot);
 			}
 		}
 	}
 }
 
 /**
- * @brief Implements the voting logic
- * @param values List containing the values returned from the servers
- * @return >0 index of the majority value, -1 there is no majority
+ * @brief      Sends a duplex request to the copies held back, when the 
+ * 		first copies disagree or don't answer in time
+ *
+ * @param      record  The record of the service
+ * @param[in]  slot    The slot of the request
  */
 
-int8_t RSF_Broker::vote(std::vector<int32_t> values, int32_t &result)
-{	
-	std::vector<uint8_t> count;
-	uint8_t max = 0;
+template<uint8_t nmr>
+void RSF_Broker<nmr>::escalate_request(service_record<nmr> *record,
+	uint32_t slot)
+{
+	request_record_t *request = db->get_request(record, slot);
+	uint32_t copies;
+
+	if (request == NULL || !request->held)
+		return;
+	WRITE_LOG(LOG_LEVEL_INFO, my_name, "Request " + 
+		std::to_string(request->seq_id) + " escalated");
+	copies = db->escalate_request(record, slot);
+	if (copies != 0)
+		send_to_copies(record, copies, *request->held);
+	request->held.reset();
+}
+
+/**
+ * @brief      Sends the voted results of a request to the client and to 
+ * 		the clients of the requests coalesced with it. The response
+ * 		is reliable only if every operation has a majority.
+ *
+ * @param      buffer     The frames of the message, the data frame is 
+ * 			  replaced with the response. The frames of the 
+ * 			  payload of the reply that decided the vote are 
+ * 			  forwarded to the client.
+ * @param      request    The request record
+ */
+
+template<uint8_t nmr>
+void RSF_Broker<nmr>::reply_client(std::vector<zmq::message_t> &buffer,
+	request_record_t *request)
+{
+	bool reliable = request->reliable && request->pending_ops == 0;
+	response_module *response;
+	int32_t *results;
+	zmq::message_t data(sizeof(response_module) + request->num_ops * 
+		sizeof(int32_t));
+
+	results = module_results<response_module>(data.data());
+	for (uint32_t op = 0; op < request->num_ops; op++)
+		results[op] = (int32_t) htonl(voter_result(request->voters[op]));
+	/* The voter of a payload counts the index of its digest */
+	if (request->digest_voting && !request->digests.empty())
+		results[0] = (int32_t) htonl(request->digests[voter_result(
+			request->voters[0])].word);
 	
-	for (uint8_t i = 0; i < values.size(); i++) {
-		count.push_back(0);
-		for (uint8_t j = 0; j < values.size(); j++) {
-			if (values[i] == values[j])
-				count[i]++;
-		}
+	init_response_module(static_cast<response_module*> (data.data()),
+		reliable ? SERVICE_AVAILABLE : SERVICE_NOT_RELIABLE, 
+		request->request_id, request->num_ops);
+	/* The reply that decides the vote has the digest of the majority, 
+	 * so its payload is forwarded as it is */
+	if (!reliable || !request->digest_voting)
+		buffer.resize(NUM_FRAMES);
+	buffer[DATA_FRAME].move(&data);
+	send_multi_msg(router, buffer);
+
+	/* The same response, with their own identifiers, for the requests
+	 * attached to this one */
+	response = static_cast<response_module*> (buffer[DATA_FRAME].data());
+	for (uint32_t i = 0; i < request->waiters.size(); i++) {
+		buffer[ID_FRAME].rebuild(request->waiters[i].client_id.data(),
+			request->waiters[i].client_id.size());
+		response->request_id = htonl(request->waiters[i].request_id);
+		send_multi_msg(router, buffer);
 	}
-	
-	for (uint8_t i = 0; i < count.size(); i++)
-			if (count[i] > count[max])
-				max = i;
-	
-	/* No result received from the server */
-	if (count.size() == 0)
-		return -1;
-		
-	if (count[max] > (nmr / 2)) {
-		result = values[max];
-		return max;
-	} else return -1;
+}
+
+/**
+ * @brief      Sends to the client the results of a request found in the 
+ * 		result cache
+ *
+ * @param      buffer      The frames of the message, the data frame is 
+ * 			   replaced with the response
+ * @param      request_id  The identifier of the request
+ * @param      results     The cached results in network byte order
+ */
 
+template<uint8_t nmr>
+void RSF_Broker<nmr>::reply_cached(std::vector<zmq::message_t> &buffer,
+	uint32_t request_id, const std::vector<int32_t> *results)
+{
+	zmq::message_t data(sizeof(response_module) + results->size() * 
+		sizeof(int32_t));
+
+	init_response_module(static_cast<response_module*> (data.data()),
+		SERVICE_AVAILABLE, request_id, results->size());
+	memcpy(module_results<response_module>(data.data()), results->data(),
+		results->size() * sizeof(int32_t));
+	buffer[DATA_FRAME].move(&data);
+	send_multi_msg(router, buffer);
 }
 
 /**
- * @brief It sends a ping to a specific group of servers
- * @param i index to the servers group
+ * @brief      Enables the result cache of a deterministic service, the
+ * 		voted results are reused for identical requests
+ *
+ * @param[in]  service  The service
+ * @param[in]  size     The maximum number of entries, 0 disables the cache
+ * @param[in]  ttl_ms   The time to live of the entries in milliseconds
+ */
+
+template<uint8_t nmr>
+void RSF_Broker<nmr>::enable_cache(service_type_t service, uint32_t size,
+	uint32_t ttl_ms)
+{
+	db->set_cache(service, size, ttl_ms);
+}
+
+/**
+ * @brief      Enables the coalescing of identical pending requests of a 
+ * 		deterministic service, they are forwarded to the servers 
+ * 		once and all of them receive the voted response
+ *
+ * @param[in]  service  The service
+ */
+
+template<uint8_t nmr>
+void RSF_Broker<nmr>::enable_coalescing(service_type_t service)
+{
+	db->set_coalescing(service, true);
+}
+
+/**
+ * @brief      Enables the duplex mode of a service, the requests are sent
+ * 		to two copies and to the other copies of the group only if
+ * 		the results differ or the first copies don't answer in time
+ *
+ * @param[in]  service  The service
+ */
+
+template<uint8_t nmr>
+void RSF_Broker<nmr>::enable_duplex(service_type_t service)
+{
+	db->set_duplex(service, true);
+}
+
+/**
+ * @brief      Sets the transport between the broker and the copies of a 
+ * 		service, TRANSPORT_SHM needs the copies on the same host
+ *
+ * @param[in]  service    The service
+ * @param[in]  transport  The transport
+ */
+
+template<uint8_t nmr>
+void RSF_Broker<nmr>::set_transport(service_type_t service, uint8_t transport)
+{
+	db->set_transport(service, transport);
+}
+
+/**
+ * @brief      Enables the affinity of the requests of a service to the 
+ * 		groups of copies, requests with the same parameters are sent
+ * 		to the same group instead of the least loaded one
+ *
+ * @param[in]  service  The service
+ */
+
+template<uint8_t nmr>
+void RSF_Broker<nmr>::enable_affinity(service_type_t service)
+{
+	db->set_affinity(service, true);
+}
+
+/**
+ * @brief Cancels a request on the copies it has been sent to that have not
+ * 	  answered yet, since their results are no longer needed
+ * @param record record of the service
+ * @param request request that has been answered
+ */
+
+template<uint8_t nmr>
+void RSF_Broker<nmr>::cancel_copies(service_record<nmr> *record,
+	request_record_t *request)
+{
+	service_module sm;
+	uint32_t copies = request->dispatched_mask & record->registered_mask &
+		~record->failed_mask & ~request->replied_mask;
+	std::vector<zmq::message_t> buffer_in(NUM_FRAMES - 1);
+
+	if (copies == 0)
+		return;
+
+	init_service_module(&sm, SM_CANCEL, request->seq_id, 0);
+	buffer_in[0].rebuild(EMPTY_MSG, 0);
+	buffer_in[1].rebuild((void*) &sm, sizeof(service_module));
+	send_to_copies(record, copies, buffer_in);
+}
+
+/**
+ * @brief It sends a ping to the reliable copies of a service
  * @param service service type
  */
 
-void RSF_Broker::ping_server(uint8_t i, service_type_t service)
+template<uint8_t nmr>
+void RSF_Broker<nmr>::ping_server(service_type_t service)
 {
 	service_module sm;
-	uint8_t num_copies_reliable;
-	std::vector<zmq::message_t> buffer_in(NUM_FRAMES);
-	char_t address_ping[LENGTH_ID_FRAME];
-	
-	address_ping[0] = 0;
-	memset((address_ping + 1), 'a', LENGTH_ID_FRAME - 1);
+	service_record<nmr> *record = db->get_record(service);
+	std::vector<zmq::message_t> buffer_in(NUM_FRAMES - 1);
 	
-	/* In order to reuse the same dealer port for receiving pong and
-	 * results we have to emulate the router-dealer-rep pattern */
-	sm.heartbeat = true;
-	sm.seq_id = htonl(db->get_ping_id(service));
-	buffer_in[ID_FRAME].rebuild((void*) &address_ping[0], 
-		sizeof(address_ping));
-	buffer_in[EMPTY_FRAME].rebuild((void*) "", 0);
-	buffer_in[DATA_FRAME].rebuild((void*) &sm, sizeof(service_module));
-	num_copies_reliable = db->get_reliable_copies(available_services[i]);
+	/* The ping carries no client identity, only the empty delimiter
+	 * after the identity of the copy, so the DEALER of the copy sends
+	 * the pong back with the same empty envelope */
+	init_service_module(&sm, SM_PING, record->seq_id_ping, 0);
+	buffer_in[0].rebuild(EMPTY_MSG, 0);
+	buffer_in[1].rebuild((void*) &sm, sizeof(service_module));
 	
-	for(uint8_t j = 0; j < num_copies_reliable; j++) {
-		send_multi_msg(dealer[i], buffer_in);
-		write_log(my_name, "Sending ping " + 
-			std::to_string(ntohl(sm.seq_id)) + " to Service " + 
-			std::to_string(service) + " Server " + 
-			std::to_string((int32_t) j));
-	}
+	send_to_copies(record, record->registered_mask & ~record->failed_mask,
+		buffer_in);
+	WRITE_LOG(LOG_LEVEL_DEBUG, my_name, "Sending ping " + 
+		std::to_string(ntohl(sm.seq_id)) + " to Service " + 
+		std::to_string(service));
 }
 
 /**
  * @brief It prints all the available services 
  */
  
-void RSF_Broker::print_available_services()
+template<uint8_t nmr>
+void RSF_Broker<nmr>::print_available_services()
 {	
 	for (uint32_t i = 0; i < available_services.size(); i++)
-		write_log(my_name, "Service " +
+		WRITE_LOG(LOG_LEVEL_INFO, my_name, "Service " +
 			std::to_string(available_services[i])); 
 }
 
@@ -419,7 +961,8 @@ void RSF_Broker::print_available_services()
  * @brief Sends the pong message to the health checker
  */
 
-void RSF_Broker::pong_health_checker()
+template<uint8_t nmr>
+void RSF_Broker<nmr>::pong_health_checker()
 {
 	zmq::message_t msg;
 	
@@ -436,7 +979,8 @@ void RSF_Broker::pong_health_checker()
  * @param service Service
  */
 
-void RSF_Broker::update_timeout(service_type_t service)
+template<uint8_t nmr>
+void RSF_Broker<nmr>::update_timeout(service_type_t service)
 {
 	uint32_t i;
 	struct timespec timeout_tmp;
@@ -454,46 +998,35 @@ void RSF_Broker::update_timeout(service_type_t service)
  * @brief Checks if a service timeout has expired
  */
 
-void RSF_Broker::check_pending_requests()
+template<uint8_t nmr>
+void RSF_Broker<nmr>::check_pending_requests()
 {
-	int32_t ret, result;
-	struct timespec now;
 	std::vector<zmq::message_t> buffer_in(NUM_FRAMES);
-	char_t address[LENGTH_ID_FRAME];
-	response_module response;
+	service_record<nmr> *record;
 	
-	clock_gettime(CLOCK_MONOTONIC, &now);
-	for (uint32_t i = 0; i < available_services.size(); i++) {
-		std::vector<request_record_t> pending_requests = 
-			db->get_pending_requests(available_services[i]);
-		for (uint32_t j = 0; j < pending_requests.size(); j++) {
-			if (time_cmp(&now, &pending_requests[j].timeout) == 1) {
-				ret = vote(pending_requests[j].results, result);
-				if (ret >= 0) {
-					/* Sending not available */
-					response.service_status =
-						(service_status_t) htonl(
-						(uint32_t) SERVICE_AVAILABLE);
-				} else {
-					/* Sending not reliable service */
-					response.service_status =
-						(service_status_t) htonl(
-						(uint32_t) SERVICE_NOT_RELIABLE);
-				}
-				address[0] = 0;
-				memcpy((address + 1), &pending_requests[j].
-					client_id, LENGTH_ID_FRAME - 1);
-				response.result = (int32_t) htonl(result);
-				buffer_in[ID_FRAME].rebuild((void*) &address[0],
-					sizeof(address));
-				buffer_in[EMPTY_FRAME].rebuild((void*)"", 0);
-				buffer_in[DATA_FRAME].rebuild((void*) &response,
-					sizeof(response_module));
-				send_multi_msg(router, buffer_in);
-				/* Deleting service request */
-				db->delete_request((service_type_t)i,
-					pending_requests[j].client_id);
-			}
+	db->get_expired_requests(&now, expired_requests);
+	for (uint32_t j = 0; j < expired_requests.size(); j++) {
+		record = db->get_record(expired_requests[j].service);
+		/* A duplex request is given to the copies held back */
+		if (expired_requests[j].reserve_mask != 0) {
+			escalate_request(record, db->find_request(record, 
+				expired_requests[j].client_id, 
+				expired_requests[j].seq_id));
+			continue;
 		}
+		buffer_in[ID_FRAME].rebuild(expired_requests[j].client_id.
+			data(), expired_requests[j].client_id.size());
+		buffer_in[EMPTY_FRAME].rebuild((void*)"", 0);
+		reply_client(buffer_in, &expired_requests[j]);
+		/* The copies that have not answered stop working on it */
+		cancel_copies(record, &expired_requests[j]);
+		/* Deleting service request */
+		db->delete_request(record, db->find_request(record, 
+			expired_requests[j].client_id, 
+			expired_requests[j].seq_id));
 	}
-}
\ No newline at end of file
+}
+
+/* Instantiations for the supported redundancies */
+template class RSF_Broker<3>;
+template class RSF_Broker<5>;
@@ -5,12 +5,46 @@
 
 #include "../../include/types.hpp"
 #include "../../include/broker_class.hpp"
+#include "../../include/sharded_broker_class.hpp"
 #include "../../include/test.hpp"
 
 
 int32_t main(int32_t argc, char_t* argv[])
 {	
-	RSF_Broker broker(NMR, ROUTER_PORT_BROKER, REG_PORT_BROKER);
+#if BROKER_SHARDS > 1
+	RSF_ShardedBroker<NMR> broker(ROUTER_PORT_BROKER, REG_PORT_BROKER,
+		BROKER_SHARDS);
+#else
+	RSF_Broker<NMR> broker(ROUTER_PORT_BROKER, REG_PORT_BROKER);
+#endif
+
+#if CACHE_SIZE > 0
+	broker.enable_cache(INCREMENT, CACHE_SIZE, CACHE_TTL_MS);
+	broker.enable_cache(DECREMENT, CACHE_SIZE, CACHE_TTL_MS);
+	broker.enable_cache(MULTIPLY2, CACHE_SIZE, CACHE_TTL_MS);
+#endif
+
+#if COALESCE_REQUESTS
+	broker.enable_coalescing(INCREMENT);
+	broker.enable_coalescing(DECREMENT);
+	broker.enable_coalescing(MULTIPLY2);
+#endif
+
+#if GROUP_AFFINITY
+	broker.enable_affinity(INCREMENT);
+	broker.enable_affinity(DECREMENT);
+	broker.enable_affinity(MULTIPLY2);
+#endif
+
+#if DUPLEX_EXECUTION
+	broker.enable_duplex(INCREMENT);
+	broker.enable_duplex(DECREMENT);
+	broker.enable_duplex(MULTIPLY2);
+#endif
+
+	broker.set_transport(INCREMENT, BACKEND_TRANSPORT);
+	broker.set_transport(DECREMENT, BACKEND_TRANSPORT);
+	broker.set_transport(MULTIPLY2, BACKEND_TRANSPORT);
 
 	broker.step();
 
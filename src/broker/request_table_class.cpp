@@ -0,0 +1,120 @@
+/*
+ *	request_table_class.cpp
+ *
+ */
+
+#include "../../include/request_table_class.hpp"
+
+/**
+ * @brief RequestTable constructor
+ */
+
+RequestTable::RequestTable()
+{
+
+}
+
+/**
+ * @brief RequestTable destructor
+ */
+
+RequestTable::~RequestTable()
+{
+
+}
+
+/**
+ * @brief Inserts a request in a free slot
+ * @param request_record Record to be inserted
+ * @return It returns the slot of the request
+ */
+
+uint32_t RequestTable::insert(request_record_t *request_record)
+{
+	uint32_t slot;
+	request_key_t key = {request_record->client_id, 
+		request_record->seq_id};
+
+	if (!free_slots.empty()) {
+		slot = free_slots.back();
+		free_slots.pop_back();
+		/* The assignment reuses the memory of the old record */
+		records[slot] = *request_record;
+	} else {
+		slot = records.size();
+		records.push_back(*request_record);
+	}
+	records[slot].in_use = true;
+	index[key] = slot;
+
+	return slot;
+}
+
+/**
+ * @brief Finds a pending request
+ * @param client_id Identity of the client
+ * @param seq_id Seq. number of the request
+ * @return It returns the slot of the request or REQUEST_NOT_FOUND
+ */
+
+uint32_t RequestTable::find(const std::string &client_id, uint32_t seq_id)
+{
+	request_key_t key = {client_id, seq_id};
+	auto it = index.find(key);
+
+	if (it == index.end())
+		return REQUEST_NOT_FOUND;
+
+	return it->second;
+}
+
+/**
+ * @brief Gets the request stored in a slot
+ * @param slot Slot of the request
+ * @return It returns the record or NULL if the slot is free
+ */
+
+request_record_t *RequestTable::get(uint32_t slot)
+{
+	if (slot >= records.size() || !records[slot].in_use)
+		return NULL;
+
+	return &records[slot];
+}
+
+/**
+ * @brief Removes a request and frees its slot
+ * @param slot Slot of the request
+ */
+
+void RequestTable::remove(uint32_t slot)
+{
+	request_record_t *record = get(slot);
+
+	if (record == NULL)
+		return;
+
+	request_key_t key = {record->client_id, record->seq_id};
+	index.erase(key);
+	record->held.reset();
+	record->in_use = false;
+	free_slots.push_back(slot);
+}
+
+/**
+ * @brief Gets the number of slots, free slots included
+ */
+
+uint32_t RequestTable::capacity()
+{
+	return records.size();
+}
+
+/**
+ * @brief Gets the number of pending requests
+ */
+
+uint32_t RequestTable::size()
+{
+	return index.size();
+}
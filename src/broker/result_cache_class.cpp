@@ -0,0 +1,152 @@
+/*
+ *	result_cache_class.cpp
+ *
+ */
+
+#include <iterator>
+#include "../../include/result_cache_class.hpp"
+#include "../../include/util.hpp"
+
+/**
+ * @brief ResultCache constructor, the cache is disabled
+ */
+
+ResultCache::ResultCache()
+{
+	this->max_size = 0;
+	this->ttl_ms = 0;
+	this->hits = 0;
+	this->misses = 0;
+}
+
+/**
+ * @brief ResultCache destructor
+ */
+
+ResultCache::~ResultCache()
+{
+
+}
+
+/**
+ * @brief Configures the cache, the entries in excess are evicted
+ * @param max_size Maximum number of entries, 0 disables the cache
+ * @param ttl_ms Time to live of the entries in milliseconds
+ */
+
+void ResultCache::configure(uint32_t max_size, uint32_t ttl_ms)
+{
+	this->max_size = max_size;
+	this->ttl_ms = ttl_ms;
+
+	while (lru.size() > max_size) {
+		index.erase(lru.back().key);
+		lru.pop_back();
+	}
+}
+
+/**
+ * @brief Checks if the cache is enabled
+ */
+
+bool ResultCache::enabled()
+{
+	return max_size > 0;
+}
+
+/**
+ * @brief Looks up the results of a request, an entry found becomes the
+ * 	  most recently used one
+ * @param key Parameters of the request
+ * @return It returns the results, NULL if they are not cached or expired
+ */
+
+const std::vector<int32_t> *ResultCache::lookup(const std::string &key)
+{
+	struct timespec now;
+	std::unordered_map<std::string,
+		std::list<cache_entry_t>::iterator>::iterator it =
+		index.find(key);
+
+	if (it == index.end()) {
+		misses++;
+		return NULL;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (time_cmp(&now, &it->second->expiry) >= 0) {
+		lru.erase(it->second);
+		index.erase(it);
+		misses++;
+		return NULL;
+	}
+
+	lru.splice(lru.begin(), lru, it->second);
+	hits++;
+
+	return &lru.front().results;
+}
+
+/**
+ * @brief Inserts the results of a request, evicting the least recently
+ * 	  used entry if the cache is full
+ * @param key Parameters of the request
+ * @param results Results of the operations in network byte order
+ * @param num_results Number of results
+ */
+
+void ResultCache::insert(const std::string &key, const int32_t *results,
+	uint32_t num_results)
+{
+	std::unordered_map<std::string,
+		std::list<cache_entry_t>::iterator>::iterator it;
+
+	if (max_size == 0)
+		return;
+
+	it = index.find(key);
+	if (it != index.end()) {
+		lru.splice(lru.begin(), lru, it->second);
+	} else {
+		if (lru.size() == max_size) {
+			/* The evicted node is reused for the new entry */
+			index.erase(lru.back().key);
+			lru.splice(lru.begin(), lru, std::prev(lru.end()));
+		} else {
+			lru.push_front(cache_entry_t());
+		}
+		lru.front().key = key;
+		index[key] = lru.begin();
+	}
+
+	lru.front().results.assign(results, results + num_results);
+	clock_gettime(CLOCK_MONOTONIC, &lru.front().expiry);
+	time_add_ms(&lru.front().expiry, ttl_ms);
+}
+
+/**
+ * @brief Gets the number of hits
+ */
+
+uint64_t ResultCache::get_hits()
+{
+	return hits;
+}
+
+/**
+ * @brief Gets the number of misses
+ */
+
+uint64_t ResultCache::get_misses()
+{
+	return misses;
+}
+
+/**
+ * @brief Gets the number of entries
+ */
+
+uint32_t ResultCache::size()
+{
+	return lru.size();
+}
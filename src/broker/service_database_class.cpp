@@ -5,385 +5,924 @@
 
 #include <iostream>
 #include <stdlib.h>
-#include <stdlib.h>
+#include <string.h>
 #include <sstream>
+#include <functional>
 #include "../../include/service_database_class.hpp"
 
 /**
  * @brief ServiceDatabase Constructor
- * 
+ *
  */
 
-ServiceDatabase::ServiceDatabase(uint8_t nmr) 
+template<uint8_t nmr>
+ServiceDatabase<nmr>::ServiceDatabase()
 {
-	this->nmr = nmr;
 	this->next_dealer_skt_index = 0;
+	for (uint32_t i = 0; i < MAX_SERVICES; i++) {
+		service_ids[i] = SERVICE_NOT_FOUND;
+		service_configs[i].cache_size = 0;
+		service_configs[i].cache_ttl_ms = 0;
+		service_configs[i].coalescing = false;
+		service_configs[i].affinity = false;
+		service_configs[i].duplex = false;
+		service_configs[i].transport = TRANSPORT_TCP;
+	}
+	records.reserve(MAX_SERVICES);
 }
 
 /**
  * @brief ServiceDatabase Denstructor
- * 
+ *
  */
 
-ServiceDatabase::~ServiceDatabase() 
+template<uint8_t nmr>
+ServiceDatabase<nmr>::~ServiceDatabase()
 {
-	
+
 }
 
 /**
- * @brief      It finds if a service is registered
+ * @brief      It gets the record of a service, it is the only lookup needed
+ * 		to handle a message
  *
  * @param[in]  service  The service
  *
- * @return     It returns -1 if there is not a service, otherwise the dealer 
- * index 
+ * @return     It returns the record, NULL if the service is not registered
  */
 
-int32_t ServiceDatabase::find_registration(service_type_t service)
-{	
-	std::unordered_map<service_type_t, service_record, 
-	service_type_hash>::iterator i = services_db.find(service);
-	
-	if (i == services_db.end()) {
-		write_log("Broker", "Service is not present");
-		return SERVICE_NOT_FOUND;
-	} 
-		
-	return (i->second).dealer_skt_index;
-}
+template<uint8_t nmr>
+service_record<nmr> *ServiceDatabase<nmr>::get_record(service_type_t service)
+{
+	if ((uint32_t) service >= MAX_SERVICES ||
+		service_ids[service] == SERVICE_NOT_FOUND)
+		return NULL;
 
+	return &records[service_ids[service]];
+}
 
 /**
- * @brief      Pushes a registration
+ * @brief      Pushes a registration, the identity and the group of the 
+ * 		server copy are recorded. A copy that registers again after 
+ * 		being considered unreliable is reliable again. The service is
+ * 		ready once nmr copies of a group have registered, the other 
+ * 		copies of the group are spares.
  *
  * @param      reg_mod  The registration module
- * @param[in]  dealer_socket  The dealer socket
+ * @param[in]  dealer_socket  The backend socket
  * 
- * @return     It returns the dealer_socket
+ * @return     It returns the backend socket port
  */
 
-uint16_t ServiceDatabase::push_registration(registration_module *reg_mod, 
+template<uint8_t nmr>
+uint16_t ServiceDatabase<nmr>::push_registration(registration_module *reg_mod, 
 	uint16_t &dealer_socket, bool &ready)
 {
 	const service_type_t service_type = reg_mod->service;
-	std::unordered_map<service_type_t, service_record, 
-		service_type_hash>::iterator i = services_db.find(service_type);
+	service_record<nmr> *record;
+	uint32_t bit, live;
 
 	ready = false;
 
-	if (i == services_db.end()) {
-		/* If not present */
-		service_record record;
+	if ((uint32_t) service_type >= MAX_SERVICES || 
+		reg_mod->id >= MAX_REPLICAS || reg_mod->group >= MAX_GROUPS)
+		return REG_FAIL;
+
+	record = get_record(service_type);
+	if (record == NULL) {
+		/* If not present, the record takes the next compact id */
+		service_ids[service_type] = records.size();
+		records.resize(records.size() + 1);
+		record = &records.back();
 		/* Init record */
-		record.owner = std::string(reg_mod->signature);
-		record.num_copies_registered = 1;
-		record.num_copies_reliable = 1;
-		record.dealer_skt_index = next_dealer_skt_index;
-		record.dealer_socket = dealer_socket;
-		record.seq_id_ping = -1;
-		record.seq_id_request = 0;
+		record->service = service_type;
+		record->ready = false;
+		strncpy(record->owner, reg_mod->signature, 
+			MAX_LENGTH_SIGNATURE - 1);
+		record->owner[MAX_LENGTH_SIGNATURE - 1] = '\0';
+		record->num_copies_registered = 0;
+		record->num_copies_reliable = 0;
+		record->dealer_skt_index = next_dealer_skt_index;
+		record->dealer_socket = dealer_socket;
+		record->seq_id_ping = -1;
+		record->seq_id_request = 0;
 		/* Init struct for reliability */
-		for (uint8_t j = 0; j < nmr; j++) {
-			record.lost_pong.push_back(-1);
-			record.new_pong.push_back(false);
+		record->registered_mask = 0;
+		record->pong_mask = 0;
+		record->failed_mask = 0;
+		record->quarantine_mask = 0;
+		for (uint8_t j = 0; j < MAX_REPLICAS; j++) {
+			record->replicas[j].lost_pong = -1;
+			record->replicas[j].pending = 0;
+			record->replicas[j].group = 0;
+			record->replicas[j].channel = NULL;
+		}
+		for (uint8_t g = 0; g < MAX_GROUPS; g++) {
+			record->groups[g].mask = 0;
+			record->groups[g].pending = 0;
 		}
+		record->cache.configure(service_configs[service_type].cache_size,
+			service_configs[service_type].cache_ttl_ms);
+		record->coalescing = service_configs[service_type].coalescing;
+		record->affinity = service_configs[service_type].affinity;
+		record->duplex = service_configs[service_type].duplex;
+		record->transport = service_configs[service_type].transport;
+		record->duplex_requests = 0;
+		record->escalations = 0;
 		
-		services_db[service_type] = record;
 		next_dealer_skt_index++;
-		
-		return dealer_socket++;
+		dealer_socket++;
+	}
+	
+	bit = 1U << reg_mod->id;
+	if (!(record->registered_mask & bit) || 
+		(record->failed_mask & bit)) {
+		record->registered_mask |= bit;
+		record->failed_mask &= ~bit;
+		record->quarantine_mask &= ~bit;
+		/* The latency of the copy is unknown */
+		record->replicas[reg_mod->id].lost_pong = -1;
+		record->replicas[reg_mod->id].probing = true;
+		record->replicas[reg_mod->id].latency_us = 0;
+		record->num_copies_registered++;
+		record->num_copies_reliable++;
+	}
+	/* The identity may change if the copy has been restarted */
+	strncpy(record->replicas[reg_mod->id].identity, reg_mod->identity,
+		MAX_LENGTH_REPLICA_ID - 1);
+	record->replicas[reg_mod->id].identity[MAX_LENGTH_REPLICA_ID - 1] = 
+		'\0';
+	/* The group may change if the copy has been redeployed */
+	record->groups[record->replicas[reg_mod->id].group].mask &= ~bit;
+	record->replicas[reg_mod->id].group = reg_mod->group;
+	record->groups[reg_mod->group].mask |= bit;
+	
+	live = record->registered_mask & ~record->failed_mask;
+	if (__builtin_popcount(record->groups[reg_mod->group].mask & live) >= 
+		nmr) {
+		record->ready = true;
+		ready = true;
+	}
+
+	return record->dealer_socket;
+}
+
+/**
+ * @brief Picks the copies with the lowest score among the candidates until
+ * 	  count copies are selected. The score grows with the latency and the
+ * 	  requests pending on the copy, a copy being probed comes first.
+ * @param record record of the service
+ * @param candidates bitmask of the copies that can be picked
+ * @param selected bitmask of the copies already selected
+ * @param count number of copies to be selected
+ * @return It returns the bitmask of the selected copies
+ */
+
+template<uint8_t nmr>
+uint32_t ServiceDatabase<nmr>::pick_copies(service_record<nmr> *record,
+	uint32_t candidates, uint32_t selected, uint8_t count)
+{
+	uint8_t num_selected = __builtin_popcount(selected);
+	uint64_t score, best_score;
+	int8_t best;
+
+	candidates &= ~selected;
+	while (num_selected < count && candidates != 0) {
+		best = -1;
+		best_score = 0;
+		for (uint8_t j = 0; j < MAX_REPLICAS; j++) {
+			if (!(candidates & (1U << j)))
+				continue;
+			replica_t *replica = &record->replicas[j];
+			score = replica->probing ? 0 : 
+				((uint64_t) replica->latency_us + 1) * 
+				(replica->pending + 1);
+			if (best < 0 || score < best_score) {
+				best = j;
+				best_score = score;
+			}
+		}
+		selected |= 1U << best;
+		candidates &= ~(1U << best);
+		num_selected++;
+	}
+
+	return selected;
+}
+
+/**
+ * @brief Selects the group of copies a request is sent to, among the groups
+ * 	  with nmr live copies if any. With affinity the group depends on 
+ * 	  the parameters of the request, otherwise it is the group with the 
+ * 	  fewest pending requests.
+ * @param record record of the service
+ * @param live bitmask of the live copies
+ * @param params_key parameters of the request
+ * @return It returns the group, -1 if there are no live copies
+ */
+
+template<uint8_t nmr>
+int8_t ServiceDatabase<nmr>::select_group(service_record<nmr> *record,
+	uint32_t live, const std::string &params_key)
+{
+	uint8_t copies[MAX_GROUPS], candidates[MAX_GROUPS];
+	uint8_t num_candidates = 0, max_copies = 0, threshold;
+	int8_t best = -1;
+
+	for (uint8_t g = 0; g < MAX_GROUPS; g++) {
+		copies[g] = __builtin_popcount(record->groups[g].mask & live);
+		if (copies[g] > max_copies)
+			max_copies = copies[g];
+	}
+	if (max_copies == 0)
+		return -1;
+
+	/* If no group can vote, the ones with the most live copies try */
+	threshold = max_copies < nmr ? max_copies : nmr;
+	for (uint8_t g = 0; g < MAX_GROUPS; g++)
+		if (copies[g] >= threshold)
+			candidates[num_candidates++] = g;
+
+	if (record->affinity && !params_key.empty())
+		return candidates[std::hash<std::string>()(params_key) % 
+			num_candidates];
+
+	for (uint8_t i = 0; i < num_candidates; i++)
+		if (best < 0 || record->groups[candidates[i]].pending < 
+			record->groups[best].pending)
+			best = candidates[i];
+
+	return best;
+}
+
+/**
+ * @brief Selects the nmr copies a request is sent to, within a group. The
+ * 	  healthy copies are preferred, the quarantined ones are used only 
+ * 	  if there are not enough healthy copies. A copy whose quarantine is
+ * 	  over is probed. In duplex mode only DUPLEX_COPIES of them are
+ * 	  returned.
+ * @param record record of the service
+ * @param params_key parameters of the request, used for the affinity
+ * @param group where to store the selected group
+ * @param reserve where to store the bitmask of the copies held back
+ * @return It returns the bitmask of the copies the request is sent to
+ */
+
+template<uint8_t nmr>
+uint32_t ServiceDatabase<nmr>::select_copies(service_record<nmr> *record,
+	const std::string &params_key, uint8_t &group, uint32_t &reserve)
+{
+	struct timespec now;
+	uint32_t live = record->registered_mask & ~record->failed_mask;
+	uint32_t selected, duplex;
+	int8_t selected_group;
+
+	reserve = 0;
+
+	if (record->quarantine_mask != 0) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		for (uint8_t j = 0; j < MAX_REPLICAS; j++) {
+			if (!(record->quarantine_mask & (1U << j)) ||
+				time_cmp(&now, 
+				&record->replicas[j].quarantine_end) < 0)
+				continue;
+			/* End of the quarantine, the next sample replaces the
+			 * latency of the copy */
+			record->quarantine_mask &= ~(1U << j);
+			record->replicas[j].probing = true;
+			WRITE_LOG(LOG_LEVEL_INFO, "Broker", "Server" + 
+				std::to_string((int32_t) j) + " probed again");
+		}
+	}
+
+	selected_group = select_group(record, live, params_key);
+	if (selected_group < 0) {
+		group = 0;
+		return 0;
+	}
+	group = selected_group;
+	live &= record->groups[group].mask;
+
+	selected = pick_copies(record, live & ~record->quarantine_mask, 0, nmr);
+	selected = pick_copies(record, live, selected, nmr);
+	/* In duplex mode the request is sent to the fastest of them, the 
+	 * others are held back */
+	if (record->duplex && __builtin_popcount(selected) > DUPLEX_COPIES) {
+		duplex = pick_copies(record, selected, 0, DUPLEX_COPIES);
+		reserve = selected & ~duplex;
+		selected = duplex;
+	}
+
+	return selected;
+}
+
+/**
+ * @brief Updates the latency of a copy with a new sample and quarantines
+ * 	  the copy if it is much slower than its fastest healthy peer
+ * @param record record of the service
+ * @param id_copy id of the server copy
+ * @param now current time
+ * @param sent time the request has been sent to the copy
+ */
+
+template<uint8_t nmr>
+void ServiceDatabase<nmr>::update_latency(service_record<nmr> *record,
+	uint8_t id_copy, struct timespec *now, struct timespec *sent)
+{
+	replica_t *replica = &record->replicas[id_copy];
+	uint32_t sample = time_diff_ns(now, sent) / 1000;
+	uint32_t peers = record->registered_mask & ~record->failed_mask & 
+		~record->quarantine_mask & ~(1U << id_copy);
+	uint32_t min_latency = 0;
+	bool found = false;
+
+	if (replica->pending > 0)
+		replica->pending--;
+	if (replica->probing) {
+		replica->latency_us = sample;
+		replica->probing = false;
 	} else {
-		
-		if ((i->second).num_copies_registered < nmr) {
-			(i->second).num_copies_registered++;
-			(i->second).num_copies_reliable++;
-		} else return REG_FAIL;
-			
-		if ((i->second).num_copies_registered == nmr) 
-			ready = true;
-		
-		return ((i->second).dealer_socket);
+		replica->latency_us = replica->latency_us - 
+			(replica->latency_us >> LATENCY_EWMA_SHIFT) +
+			(sample >> LATENCY_EWMA_SHIFT);
 	}
 
+	for (uint8_t j = 0; j < MAX_REPLICAS; j++) {
+		if (!(peers & (1U << j)) || record->replicas[j].probing)
+			continue;
+		if (!found || record->replicas[j].latency_us < min_latency)
+			min_latency = record->replicas[j].latency_us;
+		found = true;
+	}
+
+	if (found && (record->quarantine_mask & (1U << id_copy)) == 0 &&
+		replica->latency_us > QUARANTINE_MIN_US &&
+		replica->latency_us > (uint64_t) QUARANTINE_FACTOR * 
+		min_latency) {
+		record->quarantine_mask |= 1U << id_copy;
+		replica->quarantine_end = *now;
+		time_add_ms(&replica->quarantine_end, QUARANTINE_MS);
+		WRITE_LOG(LOG_LEVEL_WARNING, "Broker", "Server" + 
+			std::to_string((int32_t) id_copy) + 
+			" quarantined, latency " + 
+			std::to_string(replica->latency_us) + " us");
+	}
 }
 
 /**
  * @brief It inserts a request from the client in the database
- * @param request record to be inserted 
+ * @param record record of the service
+ * @param request_record request to be inserted
+ * @param dispatched bitmask of the copies the request has been sent to
+ * @param reserve bitmask of the copies held back in duplex mode
+ * @param group group of the copies
+ * @return It returns the slot of the request in the request table
  */
- 
-void ServiceDatabase::push_request(request_record_t *request_record, 
-	service_type_t service)
+
+template<uint8_t nmr>
+uint32_t ServiceDatabase<nmr>::push_request(service_record<nmr> *record,
+	request_record_t *request_record, uint32_t dispatched, 
+	uint32_t reserve, uint8_t group)
 {
-	std::unordered_map<service_type_t, service_record, 
-		service_type_hash>::iterator i = 
-		services_db.find(service);
-	
-	if (i == services_db.end()) {
-		std::cerr << "push_request:Service not found" << std::endl;
-		exit(EXIT_FAILURE);
-	}
+	uint32_t slot;
 
-	clock_gettime(CLOCK_MONOTONIC, &request_record->timeout);
+	clock_gettime(CLOCK_MONOTONIC, &request_record->sent);
+	request_record->timeout = request_record->sent;
 	time_add_ms(&request_record->timeout, REQUEST_TIMEOUT);
+	request_record->service = record->service;
+	request_record->dispatched_mask = dispatched;
+	request_record->reserve_mask = reserve;
+	request_record->group = group;
+	record->duplex_requests += (reserve != 0);
+	record->groups[group].pending++;
+	for (uint8_t j = 0; j < MAX_REPLICAS; j++)
+		if (dispatched & (1U << j))
+			record->replicas[j].pending++;
+
+	slot = record->request_records.insert(request_record);
+	request_record_t *request = record->request_records.get(slot);
+
+	/* Initializing the voters, a reused slot keeps their memory */
+	request->voters.resize(request->num_ops);
+	for (uint32_t op = 0; op < request->num_ops; op++)
+		voter_reset(request->voters[op]);
+	request->pending_ops = request->num_ops;
+	request->reliable = true;
+	request->num_replies = 0;
+	request->replied_mask = 0;
 	
-	(i->second).request_records.push_back(*request_record);
+	/* Identical requests will be attached to this one */
+	if (record->coalescing && !request->params_key.empty())
+		record->in_flight[request->params_key] = slot;
+
+	/* Arming the request timeout */
+	timer_expired_t timer_data = {record->service, slot};
+	request->timer = request_timers.add(&request_record->timeout,
+		timer_data);
+
+	return slot;
 }
+
+/**
+ * @brief      It finds a pending request
+ *
+ * @param[in]  record     The record of the service
+ * @param[in]  client_id  The identity of the client
+ * @param[in]  seq_id     The seq. number of the request
+ *
+ * @return     It returns the slot of the request or REQUEST_NOT_FOUND
+ */
+
+template<uint8_t nmr>
+uint32_t ServiceDatabase<nmr>::find_request(service_record<nmr> *record,
+	const std::string &client_id, uint32_t seq_id)
+{
+	return record->request_records.find(client_id, seq_id);
+}
+
+/**
+ * @brief      It gets a pending request
+ *
+ * @param[in]  record     The record of the service
+ * @param[in]  slot       The slot of the request
+ *
+ * @return     It returns the request record or NULL
+ */
+
+template<uint8_t nmr>
+request_record_t *ServiceDatabase<nmr>::get_request(
+	service_record<nmr> *record, uint32_t slot)
+{
+	return record->request_records.get(slot);
+}
+
 /**
  * @brief      It deletes a service request from the db
  *
- * @param[in]  service    The service
- * @param[in]  client_id  The client identifier
+ * @param[in]  record     The record of the service
+ * @param[in]  slot       The slot of the request
  */
 
-void ServiceDatabase::delete_request(service_type_t service, 
-	uint32_t client_id)
+template<uint8_t nmr>
+void ServiceDatabase<nmr>::delete_request(service_record<nmr> *record,
+	uint32_t slot)
 {
-	std::unordered_map<service_type_t, service_record, 
-		service_type_hash>::iterator i = 
-		services_db.find(service);
-	
-	if (i == services_db.end()) {
-		std::cerr << "delete_request:Service not found" << std::endl;
-		exit(EXIT_FAILURE);
+	request_record_t *request = record->request_records.get(slot);
+	struct timespec now;
+	uint32_t unanswered;
+
+	if (request == NULL)
+		return;
+
+	/* The copies that have not answered took at least until now */
+	unanswered = request->dispatched_mask & ~request->replied_mask;
+	if (unanswered != 0) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		for (uint8_t j = 0; j < MAX_REPLICAS; j++)
+			if (unanswered & (1U << j))
+				update_latency(record, j, &now, &request->sent);
 	}
-	
-	service_record *record = &i->second;
 
-	for (uint32_t j = 0; j < record->request_records.size(); j++) 
-		if (record->request_records[j].client_id == client_id) {			
-			record->request_records.erase(record->
-			request_records.begin() + j); 			
-		}
+	record->groups[request->group].pending--;
+
+	/* Disarming the request timeout */
+	request_timers.cancel(request->timer);
+	if (record->coalescing && !request->params_key.empty()) {
+		auto it = record->in_flight.find(request->params_key);
+		if (it != record->in_flight.end() && it->second == slot)
+			record->in_flight.erase(it);
+	}
+	record->request_records.remove(slot);
 }
 
 /**
- * @brief It updates with a result from a copy in the server
- * @param server_reply Message from the server
- * @return the number of results received
+ * @brief It updates the voters of a request with a reply from a copy in
+ * 	  the server
+ * @param record The record of the service
+ * @param id_copy Id of the server copy, a copy is counted once
+ * @param results Results of the operations in network byte order
+ * @param slot The slot of the request
+ * @return It returns VOTE_PENDING until every operation is decided, then
+ * 	   VOTE_MAJORITY if all of them have a majority, otherwise
+ * 	   VOTE_IMPOSSIBLE. A duplex request whose copies disagree gives 
+ * 	   VOTE_ESCALATE.
  */
- 
-int32_t ServiceDatabase::push_result(server_reply_t *server_reply, 
-	uint32_t client_id)
+
+template<uint8_t nmr>
+vote_status_t ServiceDatabase<nmr>::push_result(service_record<nmr> *record,
+	uint8_t id_copy, int32_t *results, uint32_t slot)
 {
-	int32_t ret = -1;
-	std::unordered_map<service_type_t, service_record, 
-		service_type_hash>::iterator i = 
-		services_db.find(server_reply->service);
-
-	if (i == services_db.end()) {
-		std::cerr << "push_result:Service not found" << std::endl;
-		exit(EXIT_FAILURE);
-	}
+	vote_status_t status;
+	struct timespec now;
+	request_record_t *request = record->request_records.get(slot);
+
+	/* Only the copies the request has been sent to are counted */
+	if (request == NULL || request->pending_ops == 0 || 
+		id_copy >= MAX_REPLICAS ||
+		!(request->dispatched_mask & (1U << id_copy)) ||
+		(request->replied_mask & (1U << id_copy)))
+		return VOTE_PENDING;
 	
-	service_record *record = &i->second;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	update_latency(record, id_copy, &now, &request->sent);
+	request->replied_mask |= 1U << id_copy;
+	request->num_replies++;
+	if (request->digest_voting)
+		classify_digest(request, results);
+	for (uint32_t op = 0; op < request->num_ops; op++) {
+		if (request->voters[op].status != VOTE_PENDING)
+			continue;
+		status = voter_push<nmr>(request->voters[op],
+			(int32_t) ntohl(results[op]));
+		request->pending_ops -= (status != VOTE_PENDING);
+		request->reliable &= (status != VOTE_IMPOSSIBLE);
+	}
 
-	for (uint32_t j = 0; j < record->request_records.size(); j++) {
-		if (record->request_records[j].client_id == client_id) {
-			record->request_records[j].results.push_back
-				(server_reply->result);
-			ret = record->request_records[j].results.size();  
-		}
+	/* Duplex mode: the request is answered if the copies agree on 
+	 * every operation, otherwise the copies held back are asked */
+	if (request->pending_ops > 0 && request->reserve_mask != 0 &&
+		request->replied_mask == request->dispatched_mask) {
+		for (uint32_t op = 0; op < request->num_ops; op++)
+			if (request->voters[op].status == VOTE_PENDING &&
+				request->voters[op].max_count != 
+				request->voters[op].received)
+				return VOTE_ESCALATE;
+		request->pending_ops = 0;
 	}
-	
-	print_htable();
-	
-	return ret;
+
+	if (request->pending_ops > 0)
+		return VOTE_PENDING;
+
+	return request->reliable ? VOTE_MAJORITY : VOTE_IMPOSSIBLE;
 }
 
 /**
- * @brief It gets the results from the database
- * @param service service type
- * @param client_id Id of the client
- * @return It returns the pointer to results
+ * @brief It sends a duplex request to the copies held back, after a 
+ * 	  disagreement or a timeout. The timeout is armed again.
+ * @param record record of the service
+ * @param slot slot of the request
+ * @return It returns the bitmask of the copies the request must be sent to
  */
 
-std::vector<int32_t> ServiceDatabase::get_result(service_type_t service, 
-	uint32_t client_id)
+template<uint8_t nmr>
+uint32_t ServiceDatabase<nmr>::escalate_request(service_record<nmr> *record,
+	uint32_t slot)
 {
-	std::vector<int32_t> ret;
-	std::unordered_map<service_type_t, service_record, 
-		service_type_hash>::iterator i = 
-		services_db.find(service);
-
-	if (i == services_db.end()) {
-		std::cerr << "get_result:Service not found" << std::endl;
-		exit(EXIT_FAILURE);
-	}
-	
-	service_record *record = &i->second;
-	
-	for (uint32_t j = 0; j < record->request_records.size(); j++) {
-		if (record->request_records[j].client_id == client_id) {
-			ret = record->request_records[j].results; 
-		}
+	request_record_t *request = record->request_records.get(slot);
+	uint32_t copies;
+
+	if (request == NULL || request->reserve_mask == 0)
+		return 0;
+
+	/* The copies failed in the meantime are skipped */
+	copies = request->reserve_mask & record->registered_mask & 
+		~record->failed_mask;
+	request->reserve_mask = 0;
+	request->dispatched_mask |= copies;
+	for (uint8_t j = 0; j < MAX_REPLICAS; j++)
+		if (copies & (1U << j))
+			record->replicas[j].pending++;
+	record->escalations++;
+
+	/* The latency of the copies held back is measured from now */
+	clock_gettime(CLOCK_MONOTONIC, &request->sent);
+	request->timeout = request->sent;
+	time_add_ms(&request->timeout, REQUEST_TIMEOUT);
+	request_timers.cancel(request->timer);
+	timer_expired_t timer_data = {record->service, slot};
+	request->timer = request_timers.add(&request->timeout, timer_data);
+
+	return copies;
+}
+
+/**
+ * @brief It replaces the result of a reply with the index of its digest
+ * 	  among the distinct digests of the request, so the voter compares
+ * 	  the digests. The payloads are not kept: the reply that decides the
+ * 	  vote carries the payload of the majority.
+ * @param request request record
+ * @param results result of the reply followed by the digest, in network 
+ * 	  byte order
+ */
+
+template<uint8_t nmr>
+void ServiceDatabase<nmr>::classify_digest(request_record_t *request,
+	int32_t *results)
+{
+	result_digest_t entry;
+	uint32_t i;
+
+	memcpy(entry.digest.bytes, results + 1, DIGEST_SIZE);
+	for (i = 0; i < request->digests.size(); i++)
+		if (memcmp(request->digests[i].digest.bytes, 
+			entry.digest.bytes, DIGEST_SIZE) == 0)
+			break;
+	if (i == request->digests.size()) {
+		entry.word = (int32_t) ntohl(results[0]);
+		request->digests.push_back(entry);
 	}
-	
-	return ret;
+	results[0] = (int32_t) htonl(i);
 }
 
 /**
- * @brief It registers the pong from the server 
+ * @brief It registers the pong from the server
+ * @param record record of the service of the server
  * @param id_copy id that identifies the server copy
- * @param service service type of the server
  */
- 
-void ServiceDatabase::register_pong(uint8_t id_copy, service_type_t service)
+
+template<uint8_t nmr>
+void ServiceDatabase<nmr>::register_pong(service_record<nmr> *record,
+	uint8_t id_copy)
 {
-	std::unordered_map<service_type_t, service_record, 
-		service_type_hash>::iterator it = 
-		services_db.find(service);
-		
-	if (it == services_db.end()) {
-		std::cerr << "register_pong:Service not found" << std::endl;
-		exit(EXIT_FAILURE);
-	}
-	
-	it->second.new_pong[id_copy] = true;
+	if (id_copy >= MAX_REPLICAS)
+		return;
+
+	record->pong_mask |= (1U << id_copy);
 }
 
 /**
  * @brief It checks if there was a pong from the server copies and evaluates if
  * 	  there's an unreliable unit if the number of pong loss is greater than
  * 	  LIVENESS
- * @param service service type of the servers to check
+ * @param record record of the service of the servers to check
  */
- 
-void ServiceDatabase::check_pong(service_type_t service)
-{	
+
+template<uint8_t nmr>
+void ServiceDatabase<nmr>::check_pong(service_record<nmr> *record)
+{
 	uint8_t unreliable_units = 0;
-	std::unordered_map<service_type_t, service_record, 
-		service_type_hash>::iterator it;
+	uint32_t bit;
 
-	it = services_db.find(service);
-	for (uint8_t j = 0; j < nmr; j++)
-		if (!it->second.new_pong[j] && 
-			it->second.lost_pong[j] < LIVENESS) {
+	for (uint8_t j = 0; j < MAX_REPLICAS; j++) {
+		bit = 1U << j;
+		if (!(record->registered_mask & bit))
+			continue;
+		if (record->pong_mask & bit) {
+			/* Restarting to count */
+			record->replicas[j].lost_pong = 0;
+		} else if (record->replicas[j].lost_pong < LIVENESS) {
 			/* It is pong loss */
-			it->second.lost_pong[j]++;
-			write_log("Broker", "Server" + std::to_string(
-				(int32_t) j) + " Pong loss: " + std::to_string(
-				(int32_t) it->second.lost_pong[j]));
+			record->replicas[j].lost_pong++;
+			WRITE_LOG(LOG_LEVEL_WARNING, "Broker", "Server" + 
+				std::to_string((int32_t) j) + " Pong loss: " + 
+				std::to_string((int32_t) 
+				record->replicas[j].lost_pong));
 			/* If the number of pong loss is equal to
 			 * liveness, the unit is unreliable */
-			if (it->second.lost_pong[j] == LIVENESS)
+			if (record->replicas[j].lost_pong == LIVENESS &&
+				!(record->failed_mask & bit)) {
+				record->failed_mask |= bit;
 				unreliable_units++;
-		} else if (it->second.new_pong[j]) {
-			it->second.new_pong[j] = false;
-			/* Restarting to count */
-			it->second.lost_pong[j] = 0;
+			}
 		}
+	}
 
-	it->second.num_copies_reliable -= unreliable_units;
-	it->second.num_copies_registered -= unreliable_units;
-	it->second.seq_id_ping++;
+	record->pong_mask = 0;
+	record->num_copies_reliable -= unreliable_units;
+	record->num_copies_registered -= unreliable_units;
+	record->seq_id_ping++;
 }
 
 /**
- * @brief Gets the number of reliable copies for the service
+ * @brief Configures the result cache of a service, it can be done before
+ * 	  the service is registered
  * @param service service type
- * @return It returns the number of reliable copies
+ * @param size Maximum number of entries, 0 disables the cache
+ * @param ttl_ms Time to live of the entries in milliseconds
  */
- 
-uint8_t ServiceDatabase::get_reliable_copies(service_type_t service)
+
+template<uint8_t nmr>
+void ServiceDatabase<nmr>::set_cache(service_type_t service, uint32_t size,
+	uint32_t ttl_ms)
 {
-	std::unordered_map<service_type_t, service_record, 
-		service_type_hash>::iterator it = 
-		services_db.find(service);
-		
-	if (it == services_db.end()) {
-		std::cerr << "get_reliable_copies:Service not found" 
-		<< std::endl;
-		exit(EXIT_FAILURE);
-	}
-	
-	return it->second.num_copies_reliable;
+	service_record<nmr> *record;
+
+	if ((uint32_t) service >= MAX_SERVICES)
+		return;
+
+	service_configs[service].cache_size = size;
+	service_configs[service].cache_ttl_ms = ttl_ms;
+	record = get_record(service);
+	if (record != NULL)
+		record->cache.configure(size, ttl_ms);
 }
 
 /**
- * @brief Gets the actual ping id for a service
+ * @brief Caches the voted results of a request, if the cache of its 
+ * 	  service is enabled. A request without a majority on every 
+ * 	  operation is not cached.
+ * @param record record of the service
+ * @param request request whose results have a majority
+ */
+
+template<uint8_t nmr>
+void ServiceDatabase<nmr>::cache_result(service_record<nmr> *record,
+	request_record_t *request)
+{
+	if (!record->cache.enabled() || request->params_key.empty() ||
+		!request->reliable || request->pending_ops > 0)
+		return;
+
+	cache_buffer.resize(request->num_ops);
+	for (uint32_t op = 0; op < request->num_ops; op++)
+		cache_buffer[op] = (int32_t) htonl(voter_result(
+			request->voters[op]));
+	record->cache.insert(request->params_key, cache_buffer.data(),
+		request->num_ops);
+}
+
+/**
+ * @brief Enables the coalescing of identical pending requests of a 
+ * 	  service, it can be done before the service is registered
  * @param service service type
- * @return It returns the current ping id 
+ * @param enable True to enable the coalescing
  */
- 
-uint32_t ServiceDatabase::get_ping_id(service_type_t service)
+
+template<uint8_t nmr>
+void ServiceDatabase<nmr>::set_coalescing(service_type_t service, 
+	bool enable)
 {
-	std::unordered_map<service_type_t, service_record, 
-		service_type_hash>::iterator it = 
-		services_db.find(service);
-		
-	if (it == services_db.end()) {
-		std::cerr << "get_reliable_copies:Service not found" 
-		<< std::endl;
-		exit(EXIT_FAILURE);
+	service_record<nmr> *record;
+
+	if ((uint32_t) service >= MAX_SERVICES)
+		return;
+
+	service_configs[service].coalescing = enable;
+	record = get_record(service);
+	if (record != NULL) {
+		record->coalescing = enable;
+		/* Pending requests can't be attached to anymore */
+		if (!enable)
+			record->in_flight.clear();
 	}
-	
-	return it->second.seq_id_ping;
 }
 
 /**
- * @brief Gets the actual request id for a service
+ * @brief Enables the affinity of the requests of a service to the groups of
+ * 	  copies, it can be done before the service is registered
  * @param service service type
- * @return It returns the current request id for the specified service
+ * @param enable True to enable the affinity
  */
- 
-uint32_t ServiceDatabase::get_request_id(service_type_t service)
+
+template<uint8_t nmr>
+void ServiceDatabase<nmr>::set_affinity(service_type_t service, bool enable)
 {
-	std::unordered_map<service_type_t, service_record, 
-		service_type_hash>::iterator it = 
-		services_db.find(service);
-		
-	if (it == services_db.end()) {
-		std::cerr << "get_reliable_copies:Service not found" 
-		<< std::endl;
-		exit(EXIT_FAILURE);
+	service_record<nmr> *record;
+
+	if ((uint32_t) service >= MAX_SERVICES)
+		return;
+
+	service_configs[service].affinity = enable;
+	record = get_record(service);
+	if (record != NULL)
+		record->affinity = enable;
+}
+
+/**
+ * @brief Enables the duplex mode of a service, the requests are sent to 
+ * 	  DUPLEX_COPIES copies and to the other selected copies only if 
+ * 	  they disagree or don't answer in time. It can be done before the 
+ * 	  service is registered.
+ * @param service service type
+ * @param enable True to enable the duplex mode
+ */
+
+template<uint8_t nmr>
+void ServiceDatabase<nmr>::set_duplex(service_type_t service, bool enable)
+{
+	service_record<nmr> *record;
+
+	if ((uint32_t) service >= MAX_SERVICES)
+		return;
+
+	service_configs[service].duplex = enable;
+	record = get_record(service);
+	if (record != NULL)
+		record->duplex = enable;
+}
+
+/**
+ * @brief Sets the transport of the backend of a service, it must be done 
+ * 	  before the service is registered
+ * @param service service type
+ * @param transport TRANSPORT_TCP, TRANSPORT_IPC or TRANSPORT_SHM
+ */
+
+template<uint8_t nmr>
+void ServiceDatabase<nmr>::set_transport(service_type_t service, 
+	uint8_t transport)
+{
+	if ((uint32_t) service >= MAX_SERVICES)
+		return;
+
+	service_configs[service].transport = transport;
+}
+
+/**
+ * @brief Attaches a request to an identical pending request, if any, so
+ * 	  that it receives the same response
+ * @param record record of the service
+ * @param params_key Parameters of the request
+ * @param client_id Identity of the client
+ * @param request_id Identifier of the request chosen by the client
+ * @return It returns true if the request has been attached
+ */
+
+template<uint8_t nmr>
+bool ServiceDatabase<nmr>::coalesce_request(service_record<nmr> *record,
+	const std::string &params_key, const std::string &client_id,
+	uint32_t request_id)
+{
+	request_record_t *request;
+	std::unordered_map<std::string, uint32_t>::iterator it;
+
+	if (!record->coalescing)
+		return false;
+
+	it = record->in_flight.find(params_key);
+	if (it == record->in_flight.end())
+		return false;
+
+	request = record->request_records.get(it->second);
+	if (request == NULL)
+		return false;
+
+	waiter_t waiter = {client_id, request_id};
+	request->waiters.push_back(waiter);
+
+	return true;
+}
+
+/**
+ * @brief      It prints a row for each service in the database, with the
+ * 		number of its pending requests. Nothing is formatted if the 
+ * 		info rows are not written.
+ */
+
+template<uint8_t nmr>
+void ServiceDatabase<nmr>::print_htable()
+{
+	if (LOG_LEVEL_INFO > LOG_LEVEL_MAX || !log_enabled(LOG_LEVEL_INFO))
+		return;
+
+	for (auto &it : records) {
+		std::stringstream ss;
+
+		ss << "Service: " << it.service << " Owner: " << it.owner << 
+			" Copies: " << (uint32_t) it.num_copies_reliable << 
+			" Socket: " << it.dealer_socket << 
+			" Pending requests: " << it.request_records.size();
+		if (it.cache.enabled())
+			ss << " Cache hits: " << it.cache.get_hits() << 
+			" misses: " << it.cache.get_misses();
+		if (it.duplex)
+			ss << " Duplex requests: " << it.duplex_requests << 
+			" escalated: " << it.escalations;
+		WRITE_LOG(LOG_LEVEL_INFO, "Broker", ss.str());
 	}
-	
-	return it->second.seq_id_request++;
 }
 
 /**
- * @brief      It prints all the pair (key, value) in the database
+ * @brief Gets the requests whose timeout is expired. Only the expired timers
+ * 	  of the wheel are visited.
+ * @param now Current time
+ * @param expired Where to store a copy of the expired requests
  */
 
-void ServiceDatabase::print_htable()
+template<uint8_t nmr>
+void ServiceDatabase<nmr>::get_expired_requests(struct timespec *now,
+	std::vector<request_record_t> &expired)
 {
-	std::stringstream ss;
-	bool log = false;
-	
-	for (auto it : services_db) {
-    		ss << "Service: " << it.first << " Owner: " 
-    		<< it.second.owner << " Copies: " << 
-    		(uint32_t)it.second.num_copies_reliable << 
-    		" Socket: " << it.second.dealer_socket;
-		
-		for (auto it_v : it.second.request_records) {
-			ss << " Client id " << (uint32_t)it_v.client_id 
-			<< " Voter values ";
-			for (auto it_val : it_v.results) { 
-				ss << it_val << " ";
-			}
-			log = true;
-			write_log("Broker", ss.str());
-		}
-		if (!log)
-			write_log("Broker", ss.str());
+	expired.clear();
+	expired_timers.clear();
+	request_timers.advance(now, expired_timers);
+
+	for (auto &timer : expired_timers) {
+		service_record<nmr> *record = get_record(timer.service);
+		if (record == NULL)
+			continue;
+		request_record_t *request =
+			record->request_records.get(timer.key);
+		if (request == NULL)
+			continue;
+		/* The timer is not armed anymore */
+		request->timer = TIMER_NONE;
+		expired.push_back(*request);
 	}
 }
 
-std::vector<request_record_t> ServiceDatabase::get_pending_requests(
-	service_type_t service)
+/**
+ * @brief Gets the time of the next event of the request timers
+ * @param deadline Where to store the time of the next event
+ * @return It returns false if there are no pending requests
+ */
+
+template<uint8_t nmr>
+bool ServiceDatabase<nmr>::get_next_request_timeout(struct timespec &deadline)
 {
-	std::vector<request_record_t> pending_requests;
-	auto it = services_db.find(service);
+	return request_timers.next_expiry(deadline);
+}
 
-	if (it == services_db.end()) {
-		std::cerr << "get_result:Service not found" << std::endl;
-		exit(EXIT_FAILURE);
-	}
-	
-	for (auto it_v : it->second.request_records)
-		pending_requests.push_back(it_v);
-	
-	return pending_requests;
-}
\ No newline at end of file
+/* Instantiations for the supported redundancies */
+template class ServiceDatabase<3>;
+template class ServiceDatabase<5>;
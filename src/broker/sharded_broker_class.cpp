@@ -0,0 +1,343 @@
+/*
+ *	sharded_broker_class.cpp
+ *
+ */
+#include <string>
+#include <iostream>
+#include "../../include/sharded_broker_class.hpp"
+#include "../../include/communication.hpp"
+#include "../../include/test.hpp"
+#include "../../include/util.hpp"
+#include "../../include/rsf_api.hpp"
+
+/**
+ * @brief Sharded broker constructor. It binds the external sockets and the
+ * 	  inproc endpoints, then it creates the shards. Their worker 
+ * 	  threads are started by step().
+ * @param port_router It is the port for client communication
+ * @param port_reg It is the port for the server registration
+ * @param num_shards Number of shards
+ * 
+ */
+
+template<uint8_t nmr>
+RSF_ShardedBroker<nmr>::RSF_ShardedBroker(uint16_t port_router, 
+	uint16_t port_reg, uint16_t num_shards)
+{
+	int32_t opt;
+	zmq::pollitem_t item;
+
+	this->num_shards = num_shards > 0 ? num_shards : 1;
+	this->pending_pongs = 0;
+	my_name = "Broker";
+
+	/* Allocating ZMQ context, with an I/O thread for each shard */
+	try {
+		context = new zmq::context_t(this->num_shards);
+	} catch (std::bad_alloc& ba) {
+		std::cerr << "bad_alloc caught: " << ba.what() << std::endl;
+		exit(EXIT_FAILURE);
+	}
+
+	/* Router socket creation */
+	router = add_socket(context, ANY_ADDRESS, port_router, ZMQ_ROUTER, 
+		BIND);
+	opt = 1;
+	router->setsockopt(ZMQ_ROUTER_MANDATORY, &opt, sizeof(int32_t));
+	/* Registration socket creation */
+	reg = add_socket(context, ANY_ADDRESS, port_reg, ZMQ_ROUTER, BIND);
+	/* Health checker socket creation */
+	hc = add_socket(context, ANY_ADDRESS, BROKER_PONG_PORT, ZMQ_REP, BIND);
+
+	/* Inproc endpoints must be bound before the shards connect */
+	for (uint16_t i = 0; i < this->num_shards; i++) {
+		shard_front.push_back(add_inproc_socket(context, 
+			SHARD_FRONT_ENDPOINT + std::to_string(i), ZMQ_PAIR, 
+			BIND));
+		shard_reg.push_back(add_inproc_socket(context, 
+			SHARD_REG_ENDPOINT + std::to_string(i), ZMQ_PAIR, 
+			BIND));
+		shard_hc.push_back(add_inproc_socket(context, 
+			SHARD_HC_ENDPOINT + std::to_string(i), ZMQ_PAIR, 
+			BIND));
+	}
+
+	/* Initialize the poll set */
+	item = {static_cast<void*>(*router), 0, ZMQ_POLLIN, 0};
+	items.push_back(item);
+	item = {static_cast<void*>(*reg), 0, ZMQ_POLLIN, 0};
+	items.push_back(item);
+	item = {static_cast<void*>(*hc), 0, ZMQ_POLLIN, 0};
+	items.push_back(item);
+	for (uint16_t i = 0; i < this->num_shards; i++) {
+		item = {static_cast<void*>(*shard_front[i]), 0, ZMQ_POLLIN, 0};
+		items.push_back(item);
+	}
+	for (uint16_t i = 0; i < this->num_shards; i++) {
+		item = {static_cast<void*>(*shard_reg[i]), 0, ZMQ_POLLIN, 0};
+		items.push_back(item);
+	}
+	for (uint16_t i = 0; i < this->num_shards; i++) {
+		item = {static_cast<void*>(*shard_hc[i]), 0, ZMQ_POLLIN, 0};
+		items.push_back(item);
+	}
+
+	/* Creating the shards */
+	for (uint16_t i = 0; i < this->num_shards; i++) {
+		try {
+			shards.push_back(new RSF_Broker<nmr>(context, i, 
+				DEALER_START_PORT + i * 
+				DEALER_PORTS_PER_SHARD));
+		} catch (std::bad_alloc& ba) {
+			std::cerr << "bad_alloc caught: " << ba.what() << 
+				std::endl;
+			exit(EXIT_FAILURE);
+		}
+	}
+}
+
+/**
+ * @brief      Destroys the object.
+ */
+
+template<uint8_t nmr>
+RSF_ShardedBroker<nmr>::~RSF_ShardedBroker()
+{
+	/* The shards never return from their loop */
+	for (uint16_t i = 0; i < workers.size(); i++)
+		workers[i].detach();
+	for (uint16_t i = 0; i < num_shards; i++) {
+		delete shard_front[i];
+		delete shard_reg[i];
+		delete shard_hc[i];
+	}
+	delete router;
+	delete reg;
+	delete hc;
+}
+
+/**
+ * @brief      Enables the result cache of a service in its shard, it must
+ * 		be called before step()
+ *
+ * @param[in]  service  The service
+ * @param[in]  size     The maximum number of entries, 0 disables the cache
+ * @param[in]  ttl_ms   The time to live of the entries in milliseconds
+ */
+
+template<uint8_t nmr>
+void RSF_ShardedBroker<nmr>::enable_cache(service_type_t service, 
+	uint32_t size, uint32_t ttl_ms)
+{
+	shards[get_shard(service)]->enable_cache(service, size, ttl_ms);
+}
+
+/**
+ * @brief      Enables the coalescing of identical pending requests of a 
+ * 		service in its shard, it must be called before step()
+ *
+ * @param[in]  service  The service
+ */
+
+template<uint8_t nmr>
+void RSF_ShardedBroker<nmr>::enable_coalescing(service_type_t service)
+{
+	shards[get_shard(service)]->enable_coalescing(service);
+}
+
+/**
+ * @brief      Enables the affinity of the requests of a service to the 
+ * 		groups of copies in its shard, it must be called before step()
+ *
+ * @param[in]  service  The service
+ */
+
+template<uint8_t nmr>
+void RSF_ShardedBroker<nmr>::enable_affinity(service_type_t service)
+{
+	shards[get_shard(service)]->enable_affinity(service);
+}
+
+/**
+ * @brief      Enables the duplex mode of a service in its shard, it must 
+ * 		be called before step()
+ *
+ * @param[in]  service  The service
+ */
+
+template<uint8_t nmr>
+void RSF_ShardedBroker<nmr>::enable_duplex(service_type_t service)
+{
+	shards[get_shard(service)]->enable_duplex(service);
+}
+
+/**
+ * @brief      Sets the transport of a service in its shard, it must be 
+ * 		called before step()
+ *
+ * @param[in]  service    The service
+ * @param[in]  transport  The transport
+ */
+
+template<uint8_t nmr>
+void RSF_ShardedBroker<nmr>::set_transport(service_type_t service, 
+	uint8_t transport)
+{
+	shards[get_shard(service)]->set_transport(service, transport);
+}
+
+/**
+ * @brief      step function of the front end
+ */
+
+template<uint8_t nmr>
+void RSF_ShardedBroker<nmr>::step()
+{
+	/* Starting the shards */
+	for (uint16_t i = 0; i < num_shards; i++)
+		workers.push_back(std::thread(&RSF_Broker<nmr>::step, 
+			shards[i]));
+
+	for (;;) {
+		zmq::poll(items, -1);
+
+		/* Check the ping from the health checker*/
+		if (items[FRONT_HC_POLL_INDEX].revents & ZMQ_POLLIN) {
+			WRITE_LOG(LOG_LEVEL_DEBUG, my_name, 
+				"Received ping from HC");
+			relay_ping();
+		}
+		/* Check for a registration request */
+		if (items[FRONT_REG_POLL_INDEX].revents & ZMQ_POLLIN) 
+			route_registration();
+		/* Check for messages on the ROUTER socket */
+		if (items[FRONT_ROUTER_POLL_INDEX].revents & ZMQ_POLLIN) 
+			route_request();
+		/* Check for the replies of the shards */
+		for (uint16_t i = 0; i < num_shards; i++) {
+			if (items[FRONT_SHARD_POLL_INDEX + i].revents & 
+				ZMQ_POLLIN)
+				route_reply(shard_front[i], router);
+			if (items[FRONT_SHARD_POLL_INDEX + num_shards + i].
+				revents & ZMQ_POLLIN)
+				route_reply(shard_reg[i], reg);
+			if (items[FRONT_SHARD_POLL_INDEX + 2 * num_shards + i].
+				revents & ZMQ_POLLIN)
+				collect_pong(i);
+		}
+	}
+}
+
+/**
+ * @brief Gets the shard that serves a service
+ * @param service service type
+ * @return It returns the index of the shard
+ */
+
+template<uint8_t nmr>
+uint16_t RSF_ShardedBroker<nmr>::get_shard(service_type_t service)
+{
+	return (uint32_t) service % num_shards;
+}
+
+/**
+ * @brief Routes a client request to the shard of its service
+ */
+
+template<uint8_t nmr>
+void RSF_ShardedBroker<nmr>::route_request()
+{
+	request_module *request;
+	
+	recv_multi_msg(router, frames);
+	if (frames.size() < NUM_FRAMES || frames[DATA_FRAME].size() < 
+		sizeof(request_module)) {
+		WRITE_LOG(LOG_LEVEL_WARNING, my_name, "Malformed request");
+		reply_status(router, frames, SERVICE_MALFORMED, 0);
+		return;
+	}
+
+	/* The frames of the payload are forwarded with the request */
+	request = static_cast<request_module*> (frames[DATA_FRAME].data());
+	forward_multi_msg(shard_front[get_shard((service_type_t) 
+		ntohl(request->service))], frames);
+}
+
+/**
+ * @brief Routes a registration to the shard of its service
+ */
+
+template<uint8_t nmr>
+void RSF_ShardedBroker<nmr>::route_registration()
+{
+	registration_module *rm;
+	
+	recv_multi_msg(reg, frames);
+	if (frames.size() != NUM_FRAMES || frames[DATA_FRAME].size() < 
+		sizeof(registration_module)) {
+		WRITE_LOG(LOG_LEVEL_WARNING, my_name, "Malformed registration");
+		return;
+	}
+
+	rm = static_cast<registration_module*> (frames[DATA_FRAME].data());
+	forward_multi_msg(shard_reg[get_shard((service_type_t) 
+		ntohl((uint32_t) rm->service))], frames);
+}
+
+/**
+ * @brief Sends to the outside a message received from a shard
+ * @param from Inproc socket of the shard
+ * @param to Socket towards the clients or the servers
+ */
+
+template<uint8_t nmr>
+void RSF_ShardedBroker<nmr>::route_reply(zmq::socket_t *from, zmq::socket_t *to)
+{
+	recv_multi_msg(from, frames);
+	forward_multi_msg(to, frames);
+}
+
+/**
+ * @brief Relays the ping of the health checker to every shard, the pong is
+ * 	  sent once all of them have answered. A shard that is stuck keeps 
+ * 	  the health checker waiting, so the broker is restarted.
+ */
+
+template<uint8_t nmr>
+void RSF_ShardedBroker<nmr>::relay_ping()
+{
+	zmq::message_t msg;
+	
+	/* Receive the ping, the next one comes after the pong */
+	hc->recv(&msg);
+	pending_pongs = num_shards;
+	for (uint16_t i = 0; i < num_shards; i++) {
+		msg.rebuild(EMPTY_MSG, 0);
+		shard_hc[i]->send(msg, ZMQ_DONTWAIT);
+	}
+}
+
+/**
+ * @brief Collects the pong of a shard, the last one of a ping is sent to 
+ * 	  the health checker
+ * @param shard Index of the shard
+ */
+
+template<uint8_t nmr>
+void RSF_ShardedBroker<nmr>::collect_pong(uint16_t shard)
+{
+	zmq::message_t msg;
+	
+	shard_hc[shard]->recv(&msg);
+	/* A pong of a ping that has already been answered is dropped */
+	if (pending_pongs == 0 || --pending_pongs > 0)
+		return;
+	
+	/* Send the pong */
+	msg.rebuild(EMPTY_MSG, 0);
+	hc->send(msg);
+}
+
+/* Instantiations for the supported redundancies */
+template class RSF_ShardedBroker<3>;
+template class RSF_ShardedBroker<5>;
@@ -0,0 +1,290 @@
+/*
+ *	timer_wheel_class.cpp
+ *
+ */
+
+#include <time.h>
+#include "../../include/timer_wheel_class.hpp"
+
+/**
+ * @brief Converts a time in wheel ticks, rounding down
+ * @param t time to be converted
+ * @return It returns the number of ticks
+ */
+
+static uint64_t time_to_tick(struct timespec *t)
+{
+	return ((uint64_t) t->tv_sec * 1000 + t->tv_nsec / 1000000) / 
+		WHEEL_TICK_MS;
+}
+
+/**
+ * @brief TimerWheel constructor
+ */
+
+TimerWheel::TimerWheel()
+{
+	struct timespec now;
+
+	for (uint8_t l = 0; l < WHEEL_LEVELS; l++) {
+		for (uint32_t s = 0; s < WHEEL_SLOTS; s++)
+			slots[l][s] = TIMER_NONE;
+		for (uint32_t w = 0; w < WHEEL_BITMAP_WORDS; w++)
+			occupied[l][w] = 0;
+	}
+	free_list = TIMER_NONE;
+	armed_timers = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	now_tick = time_to_tick(&now);
+}
+
+/**
+ * @brief TimerWheel destructor
+ */
+
+TimerWheel::~TimerWheel()
+{
+
+}
+
+/**
+ * @brief Links a node in the slot list matching its expiration time
+ * @param id Index of the node
+ */
+
+void TimerWheel::link(uint32_t id)
+{
+	timer_node_t *node = &nodes[id];
+	uint64_t delta = node->expiry - now_tick;
+	uint64_t expiry = node->expiry;
+	uint8_t level;
+
+	if (delta < ((uint64_t) 1 << WHEEL_BITS))
+		level = 0;
+	else if (delta < ((uint64_t) 1 << (2 * WHEEL_BITS)))
+		level = 1;
+	else {
+		level = 2;
+		/* Farther timers wait in the last slot and are linked
+		 * again when it cascades */
+		if (delta >= ((uint64_t) 1 << (3 * WHEEL_BITS)))
+			expiry = now_tick + 
+				((uint64_t) 1 << (3 * WHEEL_BITS)) - 1;
+	}
+
+	node->level = level;
+	node->slot = (expiry >> (level * WHEEL_BITS)) & WHEEL_MASK;
+	node->prev = TIMER_NONE;
+	node->next = slots[level][node->slot];
+	if (node->next != TIMER_NONE)
+		nodes[node->next].prev = id;
+	slots[level][node->slot] = id;
+	occupied[level][node->slot / 64] |= (uint64_t) 1 << (node->slot % 64);
+}
+
+/**
+ * @brief Unlinks a node from its slot list
+ * @param id Index of the node
+ */
+
+void TimerWheel::unlink(uint32_t id)
+{
+	timer_node_t *node = &nodes[id];
+
+	if (node->prev != TIMER_NONE)
+		nodes[node->prev].next = node->next;
+	else
+		slots[node->level][node->slot] = node->next;
+	if (node->next != TIMER_NONE)
+		nodes[node->next].prev = node->prev;
+
+	if (slots[node->level][node->slot] == TIMER_NONE)
+		occupied[node->level][node->slot / 64] &= 
+			~((uint64_t) 1 << (node->slot % 64));
+}
+
+/**
+ * @brief Moves the timers of the current slot of a level to the lower ones
+ * @param level Level to be cascaded
+ */
+
+void TimerWheel::cascade(uint8_t level)
+{
+	uint8_t slot = (now_tick >> (level * WHEEL_BITS)) & WHEEL_MASK;
+	uint32_t id = slots[level][slot], next;
+
+	slots[level][slot] = TIMER_NONE;
+	occupied[level][slot / 64] &= ~((uint64_t) 1 << (slot % 64));
+
+	while (id != TIMER_NONE) {
+		next = nodes[id].next;
+		link(id);
+		id = next;
+	}
+}
+
+/**
+ * @brief Finds the first non empty slot of a level, wrapping around
+ * @param level Level to be searched
+ * @param from First slot to be checked
+ * @return It returns the index of the slot, -1 if the level is empty
+ */
+
+int32_t TimerWheel::next_occupied(uint8_t level, uint32_t from)
+{
+	uint32_t word = from / 64;
+	uint64_t bits = occupied[level][word] & (~(uint64_t) 0 << (from % 64));
+
+	for (uint32_t i = 0; i <= WHEEL_BITMAP_WORDS; i++) {
+		if (bits != 0)
+			return word * 64 + __builtin_ctzll(bits);
+		word = (word + 1) % WHEEL_BITMAP_WORDS;
+		bits = occupied[level][word];
+	}
+
+	return -1;
+}
+
+/**
+ * @brief Arms a new timer
+ * @param timeout Absolute expiration time, it is rounded up to the next 
+ * 	  tick so that the timer never fires in advance
+ * @param data Data returned when the timer expires
+ * @return It returns the identifier of the timer
+ */
+
+uint32_t TimerWheel::add(struct timespec *timeout, timer_expired_t data)
+{
+	uint32_t id;
+	uint64_t expiry = time_to_tick(timeout);
+
+	if ((uint64_t) timeout->tv_nsec % (1000000 * WHEEL_TICK_MS) != 0)
+		expiry++;
+	if (expiry <= now_tick)
+		expiry = now_tick + 1;
+
+	if (free_list != TIMER_NONE) {
+		id = free_list;
+		free_list = nodes[id].next;
+	} else {
+		nodes.push_back(timer_node_t());
+		id = nodes.size() - 1;
+	}
+
+	nodes[id].expiry = expiry;
+	nodes[id].data = data;
+	nodes[id].armed = true;
+	link(id);
+	armed_timers++;
+
+	return id;
+}
+
+/**
+ * @brief Cancels an armed timer
+ * @param id Identifier of the timer
+ */
+
+void TimerWheel::cancel(uint32_t id)
+{
+	if (id >= nodes.size() || !nodes[id].armed)
+		return;
+
+	unlink(id);
+	nodes[id].armed = false;
+	nodes[id].next = free_list;
+	free_list = id;
+	armed_timers--;
+}
+
+/**
+ * @brief Advances the wheel up to the current time
+ * @param now Current time
+ * @param expired Where to append the data of the expired timers
+ */
+
+void TimerWheel::advance(struct timespec *now,
+	std::vector<timer_expired_t> &expired)
+{
+	uint64_t target = time_to_tick(now);
+	uint32_t id;
+	uint8_t slot;
+
+	while (now_tick < target) {
+		if (armed_timers == 0) {
+			now_tick = target;
+			break;
+		}
+		/* Nothing can expire before the next cascade if the lowest
+		 * level is empty, so jump to the end of the rotation */
+		if (next_occupied(0, 0) < 0 && (now_tick & WHEEL_MASK) != 
+			WHEEL_MASK) {
+			now_tick = now_tick | WHEEL_MASK;
+			if (now_tick > target)
+				now_tick = target;
+			continue;
+		}
+		
+		now_tick++;
+		if ((now_tick & WHEEL_MASK) == 0) {
+			if (((now_tick >> WHEEL_BITS) & WHEEL_MASK) == 0)
+				cascade(2);
+			cascade(1);
+		}
+
+		slot = now_tick & WHEEL_MASK;
+		while ((id = slots[0][slot]) != TIMER_NONE) {
+			unlink(id);
+			expired.push_back(nodes[id].data);
+			nodes[id].armed = false;
+			nodes[id].next = free_list;
+			free_list = id;
+			armed_timers--;
+		}
+	}
+}
+
+/**
+ * @brief Computes the time of the next wheel event, that is the first 
+ * 	  expiration in the lowest level or the next cascade
+ * @param deadline Where to store the time of the next event
+ * @return It returns false if there are no armed timers
+ */
+
+bool TimerWheel::next_expiry(struct timespec &deadline)
+{
+	uint64_t tick, ms;
+	int32_t slot;
+
+	if (armed_timers == 0)
+		return false;
+
+	/* Next cascade of the upper levels */
+	tick = (now_tick | WHEEL_MASK) + 1;
+	
+	slot = next_occupied(0, (now_tick + 1) & WHEEL_MASK);
+	if (slot >= 0) {
+		uint64_t distance = (slot - now_tick) & WHEEL_MASK;
+		if (distance == 0)
+			distance = WHEEL_SLOTS;
+		if (now_tick + distance < tick)
+			tick = now_tick + distance;
+	}
+
+	ms = tick * WHEEL_TICK_MS;
+	deadline.tv_sec = ms / 1000;
+	deadline.tv_nsec = (ms % 1000) * 1000000;
+
+	return true;
+}
+
+/**
+ * @brief Gets the number of armed timers
+ * @return It returns the number of armed timers
+ */
+
+uint32_t TimerWheel::size()
+{
+	return armed_timers;
+}
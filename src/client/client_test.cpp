@@ -12,26 +12,60 @@
 #include "../../include/util.hpp"
 #include "../../include/communication.hpp"
 
+#define BATCH_OPTIONS 5
 
 
 int32_t main(int32_t argc, char_t* argv[])
 {	
 	bool ret;
 	int32_t result;
+	uint8_t batch_size = 0;
 	service_type_t service;
 	std::string addr("127.0.0.1");
 	uint16_t port = 5559;
+	std::vector<std::tuple<int32_t>> batch;
+	std::vector<int32_t> results;
 	/* Instantiate the RSF_Client object */
 	RSF_Client client(addr, port);
 	/* Parsing the arguments */
-	get_arg(argc, argv, service, 1);
+	if (argc == BATCH_OPTIONS) {
+		uint8_t tmp;
+		get_arg(argc, argv, batch_size, tmp, 2);
+		service = (service_type_t) tmp;
+	} else
+		get_arg(argc, argv, service, 1);
 
+	for (uint8_t i = 0; i < batch_size; i++)
+		batch.push_back(std::make_tuple((int32_t) i));
 
 	for (uint8_t i = 0; i < 5; i++) {
+		if (batch_size > 0) {
+			ret = client.request_service_batch(service, results, 
+				batch);
+			if (ret)
+				for (uint32_t j = 0; j < results.size(); j++)
+					std::cout << "Result " << j << ": " << 
+						results[j] << std::endl;
+			continue;
+		}
+		if (service == INVERT) {
+			/* A payload larger than a chunk, inverted twice */
+			payload_t tile(3 * PAYLOAD_CHUNK_SIZE / 2, (char_t) i);
+			payload_t inverted, restored;
+			ret = client.call_payload<INVERT>(inverted, tile) &&
+				client.call_payload<INVERT>(restored, inverted);
+			if (ret)
+				std::cout << "Payload of " << inverted.size() <<
+					" bytes, first byte " << (int32_t) 
+					(uint8_t) inverted[0] << ", restored " <<
+					(restored == tile ? "ok" : "wrong") << 
+					std::endl;
+			continue;
+		}
                 ret = client.request_service(service, result, 2);
                 if (ret) 
                         std::cout << "Result " << result << std::endl;
         }
         
 	return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
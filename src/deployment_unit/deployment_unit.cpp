@@ -1,8 +1,8 @@
 /*
  * deployment_unit.cpp
  *
- * This unit deploys a redundant server. It creates num_copy_server copies
- * of a specified server.
+ * This unit deploys a redundant server. It creates num_groups groups of
+ * num_copy_server copies of a specified server.
  *
  */
 #include <sys/wait.h>
@@ -13,39 +13,43 @@
 #include "../../include/communication.hpp"
 #define NUM_OPTIONS 2
 #define NUM_MIN_NMR 1
+#define NUM_MIN_GROUPS 1
 
 
 /**
- * @brief It deploys the server copies for the specified service
+ * @brief It deploys the server copies for the specified service, the copies
+ * 	  are numbered across the groups
  * @param service service It is the server service
- * @param num_copy_server list_server_pid Array of server pid
+ * @param num_copy_server Number of copies of each group
+ * @param num_groups Number of groups
  * @param list_server_pid list of the servers PIDs
  * @param status Variable to monitor children
  */
 
-void deployment(uint8_t service, uint8_t num_copy_server, 
+void deployment(uint8_t service, uint8_t num_copy_server, uint8_t num_groups,
 	pid_t *list_server_pid, int32_t *status)
 {
 	int8_t ret;
-	uint8_t i = 0;
+	uint8_t i = 0, group;
 	pid_t hc_pid;
 	char_t server_service = static_cast<char_t>(service);
 
 	/* Server copies deployment */
 	for (;;) {
-		if (i == num_copy_server) {
+		if (i == num_copy_server * num_groups) {
 			/* Wait on the children */
 			while (true)
-				wait(&status);
+				wait(status);
 			std::cerr << "Wake up!Something happened to "
 				"my children!" << std::endl;
 			break;
 		}
 		/* Start the health checker process */
+		group = i / num_copy_server;
 		hc_pid = fork();
 		if (hc_pid == 0) {
 			ret = execlp("./RSF_start_server", &server_service,
-				&i, (char_t *)NULL);
+				&i, &group, (char_t *)NULL);
 			if (ret == -1) {
 				perror("Error execlp on healt_checker_server");
 				exit(EXIT_FAILURE);
@@ -57,28 +61,40 @@ void deployment(uint8_t service, uint8_t num_copy_server,
 
 int32_t main(int32_t argc, char_t* argv[])
 {
-	uint8_t num_copy_server, service;
+	uint8_t num_copy_server, service, num_groups = NUM_MIN_GROUPS;
 	int32_t status = 0;
 	pid_t *list_server_pid;
 
 	/* Parsing the arguments */
-	get_arg(argc, argv, num_copy_server, service, NUM_OPTIONS);
+	get_arg(argc, argv, num_copy_server, service, NUM_OPTIONS, &num_groups);
 	if (num_copy_server < NUM_MIN_NMR) {
 		std::cerr << "Error: the server copies must be greater"
 				" than " << NUM_MIN_NMR << std::endl;
 		exit(EXIT_FAILURE);
 	}
+	if (num_groups < NUM_MIN_GROUPS || num_groups > MAX_GROUPS) {
+		std::cerr << "Error: the groups must be between " << 
+			NUM_MIN_GROUPS << " and " << MAX_GROUPS << std::endl;
+		exit(EXIT_FAILURE);
+	}
+	/* Copies of a group beyond the redundancy of the broker are spares */
+	if (num_copy_server * num_groups > MAX_REPLICAS) {
+		std::cerr << "Error: the server copies must be at most " <<
+			MAX_REPLICAS << std::endl;
+		exit(EXIT_FAILURE);
+	}
 
 	/* Allocating memory for the pid of each server */
 	try {
-		list_server_pid = new pid_t[num_copy_server];
+		list_server_pid = new pid_t[num_copy_server * num_groups];
 	} catch (std::bad_alloc& ba) {
 		std::cerr << "bad_alloc caught: " << ba.what() << std::endl;
 		exit(EXIT_FAILURE);
 	}
 
 	/* Spawning server copies */
-	deployment(service, num_copy_server, list_server_pid, &status);
+	deployment(service, num_copy_server, num_groups, list_server_pid, 
+		&status);
 
 	
 	return EXIT_SUCCESS;
@@ -26,6 +26,7 @@ RSF_Client::RSF_Client(std::string addr, uint16_t port)
 	/* Client socket creation */
 	std::cout << "RSF_Client: Connecting to the Broker..." << std::endl;
 	this->socket = add_socket(context, addr, port, ZMQ_REQ, CONNECT);
+	this->next_request_id = 0;
 }
 
 /**
@@ -39,16 +40,255 @@ RSF_Client::~RSF_Client()
 	delete context;
 }
 
+/**
+ * @brief Sends a request and waits for the response
+ * @param request Request to be sent
+ * @param results Where to store the voted result of each operation
+ * @return true if the results are reliable, false otherwise
+ */
+
+bool RSF_Client::send_request(zmq::message_t &request, 
+	std::vector<int32_t> &results, const payload_t *payload, 
+	payload_t *result_payload)
+{
+	response_module response;
+	uint32_t num_ops;
+	int32_t *data;
+	std::vector<zmq::message_t> frames;
+
+	/* The payload follows the request in frames of PAYLOAD_CHUNK_SIZE */
+	if (payload != NULL && !payload->empty()) {
+		socket->send(request, ZMQ_SNDMORE);
+		payload_copy_to_frames(*payload, frames);
+		forward_multi_msg(socket, frames);
+	} else {
+		socket->send(request);
+	}
+        
+	/* Get response module, followed by the payload of the result */
+	recv_multi_msg(socket, frames);
+	zmq::message_t &reply = frames[0];
+	if (reply.size() < sizeof(response_module))
+		return false;
+	response = *(static_cast<response_module*> (reply.data()));
+	if (response.version != WIRE_VERSION) {
+		std::cout << "Unsupported protocol version" << std::endl;
+		return false;
+	}
+	if (ntohl(response.service_status) == SERVICE_NOT_RELIABLE) {
+		std::cout << "Service not reliable" << std::endl;
+		return false;
+	} else if (ntohl(response.service_status) ==  SERVICE_NOT_AVAILABLE) {
+		std::cout << "Service not available" << std::endl;
+		return false;
+	} else if (ntohl(response.service_status) == SERVICE_MALFORMED) {
+		std::cout << "Malformed request" << std::endl;
+		return false;
+	}
+
+	num_ops = ntohl(response.num_ops);
+	if (num_ops == 0 || reply.size() != sizeof(response_module) + 
+		num_ops * sizeof(int32_t))
+		return false;
+
+	data = module_results<response_module>(reply.data());
+	results.resize(num_ops);
+	for (uint32_t i = 0; i < num_ops; i++)
+		results[i] = (int32_t) ntohl(data[i]);
+	if (result_payload != NULL)
+		frames_to_payload(frames, 1, *result_payload);
+
+	return true;
+}
+
+/**
+ * @brief RSF_AsyncClient constructor
+ * @param addr Address of the Broker
+ * @param port Listening port of the Broker
+ * @param window Max number of requests in flight
+ */
+
+RSF_AsyncClient::RSF_AsyncClient(std::string addr, uint16_t port, 
+	uint32_t window)
+{
+	/* Allocating ZMQ context */
+	try {
+		this->context = new zmq::context_t(1);
+	} catch (std::bad_alloc& ba) {
+		std::cerr << "bad_alloc caught: " << ba.what() << std::endl;
+		exit(EXIT_FAILURE);
+	}
+	
+	/* Client socket creation */
+	std::cout << "RSF_AsyncClient: Connecting to the Broker..." << 
+		std::endl;
+	this->socket = add_socket(context, addr, port, ZMQ_DEALER, CONNECT);
+	this->next_request_id = 0;
+	this->window = window > 0 ? window : 1;
+	in_flight.reserve(this->window);
+}
+
+/**
+ * @brief RSF_AsyncClient object destructor
+ */
+
+RSF_AsyncClient::~RSF_AsyncClient()
+{
+	delete socket;
+	delete context;
+}
+
+/**
+ * @brief Sends a request, waiting for a free slot if the window is full
+ * @param request Request to be sent
+ * @param call Pending call to be completed by the response
+ * @return It returns the id of the request
+ */
+
+uint32_t RSF_AsyncClient::send_request(zmq::message_t &request, 
+	pending_call_t &call)
+{
+	uint32_t request_id = next_request_id++;
+	zmq::message_t delimiter;
+
+	while (in_flight.size() >= window)
+		process_replies(-1);
+
+	in_flight.insert(std::make_pair(request_id, std::move(call)));
+
+	/* The empty delimiter emulates the envelope of a REQ socket */
+	socket->send(delimiter, ZMQ_SNDMORE);
+	socket->send(request);
+
+	return request_id;
+}
+
+/**
+ * @brief Completes the requests whose response has been received
+ * @param timeout Milliseconds to wait for the first response, 0 to return
+ * 	  immediately, -1 to wait forever
+ * @return It returns the number of completed requests
+ */
+
+uint32_t RSF_AsyncClient::process_replies(int64_t timeout)
+{
+	uint32_t completed = 0, frame = 0;
+	int32_t more;
+	size_t more_size;
+	response_module response;
+	rsf_response_t outcome;
+	zmq::message_t msg;
+	zmq::pollitem_t item = {static_cast<void*>(*socket), 0, ZMQ_POLLIN, 0};
+
+	if (in_flight.empty())
+		return 0;
+
+	zmq::poll(&item, 1, timeout);
+	if (!(item.revents & ZMQ_POLLIN))
+		return 0;
+
+	/* Draining all the queued responses, a response is made of the
+	 * empty delimiter and the response module, the frames of a 
+	 * payload are discarded */
+	while (socket->recv(&msg, ZMQ_DONTWAIT)) {
+		more_size = sizeof(more);
+		socket->getsockopt(ZMQ_RCVMORE, &more, &more_size);
+		if (frame++ != 1) {
+			if (!more)
+				frame = 0;
+			continue;
+		}
+		if (!more)
+			frame = 0;
+		if (msg.size() < sizeof(response_module))
+			continue;
+
+		response = *(static_cast<response_module*> (msg.data()));
+		if (response.version != WIRE_VERSION)
+			continue;
+		outcome.request_id = ntohl(response.request_id);
+		outcome.service_status = (service_status_t) ntohl(
+			(uint32_t) response.service_status);
+		outcome.result = 0;
+		if (ntohl(response.num_ops) > 0 && msg.size() >= 
+			sizeof(response_module) + sizeof(int32_t))
+			outcome.result = (int32_t) ntohl(
+				module_results<response_module>(msg.data())[0]);
+
+		auto it = in_flight.find(outcome.request_id);
+		if (it == in_flight.end())
+			continue;
+		if (it->second.callback)
+			it->second.callback(outcome);
+		else
+			it->second.promise.set_value(outcome);
+		in_flight.erase(it);
+		completed++;
+	}
+
+	return completed;
+}
+
+/**
+ * @brief Waits until all the requests in flight are completed
+ */
+
+void RSF_AsyncClient::wait_all()
+{
+	while (!in_flight.empty())
+		process_replies(-1);
+}
+
+/**
+ * @brief Gets the file descriptor of the socket, so that the completions 
+ * 	  can be driven by an external event loop. The descriptor is edge 
+ * 	  triggered: when it becomes readable process_replies(0) must be 
+ * 	  called until it returns 0.
+ * @return It returns the file descriptor
+ */
+
+int32_t RSF_AsyncClient::get_fd()
+{
+	int32_t fd;
+	size_t fd_size = sizeof(fd);
+
+	socket->getsockopt(ZMQ_FD, &fd, &fd_size);
+
+	return fd;
+}
+
+/**
+ * @brief Gets the number of requests in flight
+ */
+
+uint32_t RSF_AsyncClient::get_in_flight()
+{
+	return in_flight.size();
+}
+
+/**
+ * @brief Sets the max number of requests in flight
+ * @param window Number of requests
+ */
+
+void RSF_AsyncClient::set_window(uint32_t window)
+{
+	this->window = window > 0 ? window : 1;
+}
+
 /**
  * @brief It requests to the broker to register the server copies. 
  * @param reg_mod Registration module to forward to the broker for a request
  * @param socket socket used for the communication
+ * @param transport where to store the transport of the backend
  * @retval It returns the broker dealer port if the service is accepted, 
  * 	   otherwise 0
  */
  
-int32_t register_service(registration_module *reg_mod, zmq::socket_t *socket)
+int32_t register_service(registration_module *reg_mod, zmq::socket_t *socket,
+	uint8_t *transport)
 {
+	registration_reply_t rr;
 	uint16_t dealer_port;
 	static bool send_reg = false;
 	bool ret;
@@ -69,7 +309,11 @@ int32_t register_service(registration_module *reg_mod, zmq::socket_t *socket)
 		return -1;
 		
 	send_reg = false;
-	dealer_port = ntohs(*(static_cast<uint16_t*> (reply.data())));
+	if (reply.size() < sizeof(registration_reply_t))
+		return 0;
+	rr = *(static_cast<registration_reply_t*> (reply.data()));
+	dealer_port = ntohs(rr.port);
+	*transport = rr.transport;
 
 	return dealer_port;
 }
\ No newline at end of file
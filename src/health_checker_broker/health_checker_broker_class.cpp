@@ -50,7 +50,7 @@ void HealthCheckerBroker::step()
 		timeout = true;
 		
 		if (item.revents & ZMQ_POLLIN) {
-			write_log(my_name,
+			WRITE_LOG(LOG_LEVEL_DEBUG, my_name,
 				"Received pong from broker");
 			hb_skt->recv(&buffer);
 			hb_liveness = HEARTBEAT_LIVENESS;
@@ -67,11 +67,11 @@ void HealthCheckerBroker::step()
 				pong_arrived = false;
 			} else if (--hb_liveness == 0) {
 				hb_liveness = HEARTBEAT_LIVENESS;
-				write_log(my_name,
+				WRITE_LOG(LOG_LEVEL_ERROR, my_name,
 				          "Broker down... Restarting");
 				restart_process();
 			} else
-				write_log(my_name,
+				WRITE_LOG(LOG_LEVEL_WARNING, my_name,
 				          "Broker timeout");
 		}
 	}
@@ -89,10 +89,12 @@ void HealthCheckerBroker::restart_process()
 		ret = execlp("./RSF_broker", name, (char_t *) NULL);
 		if (ret == -1) {
 			perror("Error execlp on restarting broker");
-			exit(EXIT_FAILURE);
+			/* The child doesn't run the exit handlers copied
+			 * from the health checker, as its logger */
+			_exit(EXIT_FAILURE);
 		}
 	}
-	write_log(my_name, "Broker restarted, new PID: " + 
+	WRITE_LOG(LOG_LEVEL_INFO, my_name, "Broker restarted, new PID: " + 
 		std::to_string(pid));
 }
 
@@ -18,6 +18,7 @@ int32_t main(int32_t argc, char_t* argv[])
 	uint16_t srv_port;
 	uint8_t srv_id;
 	uint8_t srv_service;
+	uint8_t srv_group;
 	pid_t srv_pid;
 	int32_t ret;
 	
@@ -28,13 +29,14 @@ int32_t main(int32_t argc, char_t* argv[])
 	
 	srv_service = *argv[0];
 	srv_id = *argv[1];
-	srv_port = SERVER_PONG_PORT + srv_id + srv_service * MAX_NMR;
+	srv_group = *argv[2];
+	srv_port = SERVER_PONG_PORT + srv_id + srv_service * MAX_REPLICAS;
 	
 	/* Start the server process */
 	srv_pid = fork();
 	if (srv_pid == 0) {
 		/* Becoming one of the redundant copies */
-		ret = execlp("./RSF_server", argv[0], argv[1],
+		ret = execlp("./RSF_server", argv[0], argv[1], argv[2],
 			(char_t *)NULL);
 		if (ret == -1) {
 			perror("Error execlp on server");
@@ -45,7 +47,7 @@ int32_t main(int32_t argc, char_t* argv[])
 	/* Instanciate the health checker */
 	try {
 		hb = new HealthCheckerServer(srv_pid, srv_port, srv_id, 
-			srv_service);
+			srv_service, srv_group);
 	} catch (std::bad_alloc& ba) {
 		std::cerr << "bad_alloc caught: " << ba.what() <<  std::endl;
 		exit(EXIT_FAILURE);
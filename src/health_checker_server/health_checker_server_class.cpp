@@ -17,16 +17,18 @@
  * @param srv_id ID of the monitored service redundant copy
  * @param srv_service Service provided by yhe monitored server
  * @param srv_port Port address for the server socket
+ * @param group Group of the monitored service redundant copy
  */
 
 HealthCheckerServer::HealthCheckerServer(pid_t pid, uint16_t port, uint8_t server_id, 
-	uint8_t service) : HealthChecker(pid, port)
+	uint8_t service, uint8_t group) : HealthChecker(pid, port)
 {
 	this->server_id = server_id;
 	this->service = service;
+	this->group = group;
 	this->my_name = "HC_Server" + std::to_string((int32_t) server_id);
 	
-	write_log(my_name, "Server PID " + std::to_string(pid) 
+	WRITE_LOG(LOG_LEVEL_INFO, my_name, "Server PID " + std::to_string(pid) 
 		+ " Server port: " + std::to_string(port));
 }
 
@@ -58,7 +60,7 @@ void HealthCheckerServer::step()
 		timeout = true;
 		
 		if (item.revents & ZMQ_POLLIN) {
-			write_log(my_name, 
+			WRITE_LOG(LOG_LEVEL_DEBUG, my_name, 
 				"Received pong from server " + std::to_string(
 				(int32_t)server_id));
 			hb_skt->recv(&buffer);
@@ -76,11 +78,11 @@ void HealthCheckerServer::step()
 				pong_arrived = false;
 			} else if (--hb_liveness == 0){
 				hb_liveness = HEARTBEAT_LIVENESS;
-				write_log(my_name,
+				WRITE_LOG(LOG_LEVEL_ERROR, my_name,
 					"Server down... Restarting");
 				restart_process();
 				} else
-					write_log(my_name,
+					WRITE_LOG(LOG_LEVEL_WARNING, my_name,
 					"Server timeout");
 		}
 	}
@@ -89,21 +91,27 @@ void HealthCheckerServer::step()
 void HealthCheckerServer::restart_process()
 {
 	int32_t ret;
-	char_t server_service = static_cast<char_t>(service);
+	/* The server reads the first byte of each argument, the arguments
+	 * are terminated strings like the ones of the first start */
+	char_t server_service[2] = {static_cast<char_t>(service), '\0'};
+	char_t server_copy[2] = {static_cast<char_t>(server_id), '\0'};
+	char_t server_group[2] = {static_cast<char_t>(group), '\0'};
 	
 	/* Kill the faulty server process and start a new one */
 	kill(pid, SIGKILL);
 	pid = fork();
 	if (pid == 0) {
 		/* New server process */
-		ret = execlp("./RSF_server", &server_service, &server_id,
-					(char_t *)NULL);
+		ret = execlp("./RSF_server", server_service, server_copy,
+					server_group, (char_t *)NULL);
 		if (ret == -1) {
 			perror("Error execlp on restarting server");
-			exit(EXIT_FAILURE);
+			/* The child doesn't run the exit handlers copied
+			 * from the health checker, as its logger */
+			_exit(EXIT_FAILURE);
 		}
 	}
-	write_log(my_name, "Server " + 
+	WRITE_LOG(LOG_LEVEL_INFO, my_name, "Server " + 
 		std::to_string((int32_t)server_id) + " restarted, new PID: " + 
 		std::to_string(pid));
 }
\ No newline at end of file
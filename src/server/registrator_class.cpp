@@ -15,15 +15,22 @@
 /**
  * @brief DeploymentUnit constructor that initializes all the private data 
  * @param service Service type of the server copies
+ * @param id Identifier among the server copies
+ * @param group Group of the copy
+ * @param identity Identity of the socket receiving the requests
  * @param reg_port Broker port for registering server copies
  * 
  */
 
 Registrator::Registrator(std::string broker_address, service_type_t service, 
-	uint16_t reg_port, zmq::context_t *ctx)
+	uint8_t id, uint8_t group, std::string identity, uint16_t reg_port, 
+	zmq::context_t *ctx)
 {
 	this->broker_address = broker_address;
 	this->service = service;
+	this->id = id;
+	this->group = group;
+	this->identity = identity;
 	this->reg_port = reg_port;
 
 	/* Create the ZMQ Socket to register the service */
@@ -45,10 +52,12 @@ Registrator::~Registrator()
 
 /**
  * @brief This function registers the server 
- * 
+ * @param transport Where to store the transport of the backend
+ * @return It returns the backend port, 0 if the registration failed and 
+ * 	   -1 if the broker didn't answer
  */
 
-int32_t Registrator::registration()
+int32_t Registrator::registration(uint8_t *transport)
 {	
 	int32_t dealer_port;
 	registration_module rm;
@@ -57,9 +66,14 @@ int32_t Registrator::registration()
 	rm.service = service;
 	memset(rm.signature, '\0', sizeof(rm.signature));
 	strcpy(rm.signature, "pippo");
+	/* The broker will address this copy by its identity */
+	rm.id = id;
+	rm.group = group;
+	memset(rm.identity, '\0', sizeof(rm.identity));
+	identity.copy(rm.identity, sizeof(rm.identity) - 1);
 
 	/* Registering */
-	dealer_port = register_service(&rm, reg);
+	dealer_port = register_service(&rm, reg, transport);
 
 	return dealer_port;
 }
@@ -0,0 +1,99 @@
+/*
+ *	sequence_window_class.cpp
+ *
+ */
+
+#include <string.h>
+#include "../../include/sequence_window_class.hpp"
+
+/**
+ * @brief SequenceWindow constructor, the window is empty
+ */
+
+SequenceWindow::SequenceWindow()
+{
+	reset();
+}
+
+/**
+ * @brief Empties the window, the next seq id received starts it
+ */
+
+void SequenceWindow::reset()
+{
+	memset(this->received, 0, sizeof(this->received));
+	this->top = 0;
+	this->empty = true;
+}
+
+/**
+ * @brief Sets the bit of a seq id
+ */
+
+void SequenceWindow::set(uint32_t seq_id, bool value)
+{
+	uint32_t bit = seq_id % SEQ_WINDOW_SIZE;
+
+	if (value)
+		received[bit / 64] |= 1ULL << (bit % 64);
+	else
+		received[bit / 64] &= ~(1ULL << (bit % 64));
+}
+
+/**
+ * @brief Tests the bit of a seq id
+ */
+
+bool SequenceWindow::test(uint32_t seq_id)
+{
+	uint32_t bit = seq_id % SEQ_WINDOW_SIZE;
+
+	return (received[bit / 64] >> (bit % 64)) & 1;
+}
+
+/**
+ * @brief Checks a seq id and records it. A seq id above the highest one
+ * 	  slides the window, forgetting the oldest ids.
+ * @param seq_id Seq id of a request
+ * @return It returns false if the seq id has been already received or it
+ * 	   is older than the window
+ */
+
+bool SequenceWindow::accept(uint32_t seq_id)
+{
+	int32_t distance = (int32_t) (seq_id - top);
+
+	if (empty) {
+		empty = false;
+		top = seq_id;
+		set(seq_id, true);
+		return true;
+	}
+
+	if (distance > 0) {
+		/* The bits of the ids skipped are reused for them */
+		if (distance >= SEQ_WINDOW_SIZE)
+			memset(received, 0, sizeof(received));
+		else
+			for (uint32_t id = top + 1; id != seq_id; id++)
+				set(id, false);
+		top = seq_id;
+		set(seq_id, true);
+		return true;
+	}
+
+	if (-(int64_t) distance >= SEQ_WINDOW_SIZE || test(seq_id))
+		return false;
+	set(seq_id, true);
+
+	return true;
+}
+
+/**
+ * @brief Gets the highest seq id received
+ */
+
+uint32_t SequenceWindow::get_top()
+{
+	return top;
+}
@@ -7,7 +7,8 @@
 #include <stdio.h>
 #include <time.h>
 #include <ctime>
-#include <thread>
+#include <pthread.h>
+#include <sched.h>
 #include "../../include/server_class.hpp"
 #include "../../include/communication.hpp"
 #include "../../include/test.hpp"
@@ -19,6 +20,7 @@
  * @brief Server constructor that initializes alle the private data and
  * 	  claims memory for ZMQ sockets. Then it connects to the socket.
  * @param id_server Identifier among server copies
+ * @param group Group of the copy, the requests are voted within a group
  * @param service_t Service type to be deployed
  * @param server_p Server receive port
  * @param broker_addr Broker address
@@ -26,18 +28,26 @@
  * 
  */
 
-RSF_Server::RSF_Server(uint8_t id, uint8_t service_type, 
+RSF_Server::RSF_Server(uint8_t id, uint8_t group, uint8_t service_type, 
 	std::string broker_address, uint16_t broker_port) 
 {
 	this->id = id;
 	this->service_type = (service_type_t)service_type;
 	this->broker_address = broker_address;
-	this->service = get_service_body(this->service_type);
+	this->service = get_service_executor(this->service_type);
+	if (this->service == NULL) {
+		std::cerr << "Service not supported! Server Crash" << std::endl;
+		exit(EXIT_FAILURE);
+	}
 	this->service_thread.service = service;
 	this->service_thread.service_type = this->service_type;
-	this->service_thread.id = id;
 	this->ping_id = 0;
-	this->request_id = 0;
+	this->reply = NULL;
+	this->transport = TRANSPORT_TCP;
+	this->channel = NULL;
+	this->busy_poll = false;
+	this->identity = "S" + std::to_string((int32_t) service_type) + "-" +
+		std::to_string((int32_t) id);
 	
 	/* Allocating ZMQ context */
 	try {
@@ -47,10 +57,17 @@ RSF_Server::RSF_Server(uint8_t id, uint8_t service_type,
 		exit(EXIT_FAILURE);
 	}
 
+	try {
+		pool = new WorkerPool(WORKER_THREADS);
+	} catch (std::bad_alloc& ba) {
+		std::cerr << "bad_alloc caught: " << ba.what() << std::endl;
+		exit(EXIT_FAILURE);
+	}
+
 	try {
 		registrator = new Registrator(broker_address, 
-			(service_type_t) service_type, broker_port, 
-			context);
+			(service_type_t) service_type, id, group, identity, 
+			broker_port, context);
 	} catch (std::bad_alloc& ba) {
 		std::cerr << "bad_alloc caught: " << ba.what() << std::endl;
 		exit(EXIT_FAILURE);
@@ -58,7 +75,7 @@ RSF_Server::RSF_Server(uint8_t id, uint8_t service_type,
 
 	/* Add the pong socket */
 	hc_pong = add_socket(context, ANY_ADDRESS, SERVER_PONG_PORT + id +
-		service_type * MAX_NMR, ZMQ_REP, BIND);
+		service_type * MAX_REPLICAS, ZMQ_REP, BIND);
 	my_name = "Server" + std::to_string((int32_t)id);
 }
 
@@ -69,105 +86,163 @@ RSF_Server::RSF_Server(uint8_t id, uint8_t service_type,
 
 RSF_Server::~RSF_Server()
 {
-	delete context;
+	delete pool;
+	delete channel;
 	delete reply;
 	delete registrator;
+	delete context;
 }
 
 /**
- * @brief Server step function used to perform all the computation.
+ * @brief Makes the copy poll without blocking, spending a core to receive
+ * 	  the requests and send the replies with the lowest latency. It 
+ * 	  must be called before step().
+ * @param cpu Core the main thread is pinned to, -1 to leave it unpinned.
+ * 	  The workers are not pinned.
+ */
+
+void RSF_Server::enable_busy_poll(int32_t cpu)
+{
+	cpu_set_t set;
+
+	busy_poll = true;
+	if (cpu < 0)
+		return;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+		std::cerr << "Error pinning the server to CPU " << cpu <<
+			std::endl;
+}
+
+/**
+ * @brief Server step function used to perform all the computation. The 
+ * 	  poll blocks until a message, a completion or the deadline of the
+ * 	  ping of the broker, unless the busy poll is enabled.
  */
 
 void RSF_Server::step()
 {	 
 	uint32_t received_id;
-	char_t val[PARAM_SIZE];
+	std::shared_ptr<zmq::message_t> request;
+	std::shared_ptr<payload_t> payload;
+	std::string client_id;
 	int32_t ping_loss = 0;
 	struct timespec tmp_t, time_t;
-	bool heartbeat, reg_ok = false;
+	bool reg_ok = false;
+	uint8_t type;
 	
 	server_reply_t server_reply;
 
 	/* Adding the sockets to the poll set */
 	zmq::pollitem_t item = {static_cast<void*>(*hc_pong), 0, ZMQ_POLLIN, 0};
-	items.push_back(item);;
+	items.push_back(item);
+	item = {NULL, pool->get_fd(), ZMQ_POLLIN, 0};
+	items.push_back(item);
 	
+	clock_gettime(CLOCK_MONOTONIC, &tmp_t);
 	for (;;) {
-		zmq::poll(items, 0);
+		/* Before the registration the registrator blocks instead */
+		if (busy_poll || !reg_ok)
+			zmq::poll(items, 0);
+		else
+			zmq::poll(items, time_to_deadline_ms(&tmp_t, &time_t));
 		clock_gettime(CLOCK_MONOTONIC, &tmp_t);
 		
-		/* Check for a service request */
-		if (reg_ok && (items[SERVICE_REQUEST_INDEX].revents 
-			& ZMQ_POLLIN)) {
-			heartbeat = receive_request(val, &received_id);
-			clock_gettime(CLOCK_MONOTONIC, &time_t);
-			time_add_ms(&time_t, 
-					HEARTBEAT_INTERVAL + WCDPING);
-			if (!heartbeat) {
-				if (request_id == 0)
-					request_id = received_id;
-				write_log(my_name, "Received request " + 
-				std::to_string(received_id) + " expected " +
-				std::to_string(request_id));
-				if (received_id == request_id) {
-					request_id++;
-					/* Spawning a thread to service 
-					 * the request */
-					create_thread(val);
+		/* Check for a service request, on the reply socket or on 
+		 * the shared memory channel */
+		if (reg_ok && ((items[SERVICE_REQUEST_INDEX].revents |
+			(channel != NULL ? items[SHM_CHANNEL_INDEX].revents : 
+			0)) & ZMQ_POLLIN)) {
+			type = receive_request(request, payload, 
+				&received_id, client_id);
+			/* The deadline is moved from the time of the poll */
+			time_copy(&time_t, &tmp_t);
+			time_add_ms(&time_t, HEARTBEAT_INTERVAL + WCDPING);
+			if (type == SM_CANCEL) {
+				cancel_request(received_id);
+			} else if (type == SM_REQUEST) {
+				WRITE_LOG(LOG_LEVEL_DEBUG, my_name, 
+				"Received request " + 
+				std::to_string(received_id) + " highest " +
+				std::to_string(requests.get_top()));
+				/* The requests can be in flight in any 
+				 * order, only the duplicates are refused */
+				if (requests.accept(received_id)) {
+					/* Submitting the request to 
+					 * the workers */
+					submit_request(request, payload,
+						received_id, client_id);
 				} else {
 					zmq::message_t msg(
 						sizeof(server_reply_t));
-					server_reply.id = id;
-					server_reply.heartbeat = false;
-					server_reply.service = (service_type_t)
-						htonl((uint32_t) service_type);
+					init_server_reply(&server_reply, id,
+						service_type, received_id, 0);
 					server_reply.duplicated = true;
 					memcpy(msg.data(), (void*) 
 						&server_reply, 
 						sizeof(server_reply_t));
-					reply->send(msg);
+					send_broker(client_id, msg);
 				}
 
-			} else {
+			} else if (type == SM_PING) {
 				if (ping_id == 0)
 					ping_id = received_id;
-				write_log(my_name, "Received ping " + 
+				WRITE_LOG(LOG_LEVEL_DEBUG, my_name, 
+				"Received ping " + 
 				std::to_string(received_id) + " expected " +
 				std::to_string(ping_id));
 				if (received_id == ping_id) 
 					ping_id++;
 				
-				write_log(my_name, "Send pong " + 
-					std::to_string(ping_id) + " to Broker");
+				WRITE_LOG(LOG_LEVEL_DEBUG, my_name, 
+					"Send pong " + std::to_string(ping_id) +
+					" to Broker");
 				pong_broker();
+				log_pool();
 			}
 		}
 		
+		/* Replies of the requests elaborated in the meanwhile */
+		if (reg_ok && (busy_poll || 
+			(items[COMPLETION_INDEX].revents & ZMQ_POLLIN)))
+			send_completions();
+		
 		if (items[SERVER_PONG_INDEX].revents & ZMQ_POLLIN) {
 			/* Receive the ping from the health checker */
-			write_log(my_name, "Received ping from HC");
+			WRITE_LOG(LOG_LEVEL_DEBUG, my_name, 
+				"Received ping from HC");
 			pong_health_checker();
 		}
 		
 		if (!reg_ok) 
 			{
 			/* Add the reply socket */
-			this->broker_port = registrator->registration();
+			this->broker_port = registrator->registration(
+				&transport);
 			if (this->broker_port > 0 && this->broker_port <= 65535) 
 				{
-				write_log(my_name, "Registration Ok!" 
-					 " Received port " + 
+				WRITE_LOG(LOG_LEVEL_INFO, my_name, 
+					"Registration Ok! Received port " + 
 					std::to_string(this->broker_port));
-				/* In this case the REP socket requires 
-				 * the connect() method! */
+				/* The DEALER socket connects to the 
+				 * broker ROUTER, that addresses it by its
+				 * identity */
 				delete reply;
-				reply = add_socket(context, broker_address, 
-				broker_port, ZMQ_REP, CONNECT);
+				reply = add_endpoint_socket(context, 
+					transport_endpoint(transport, 
+					broker_address, broker_port), 
+					ZMQ_DEALER, CONNECT, identity);
 				item = {static_cast<void*>(*reply), 0, 
 					ZMQ_POLLIN, 0};
 				items.push_back(item);
+				if (transport == TRANSPORT_SHM)
+					attach_channel();
 				reg_ok = true;
 				ping_loss = 0;
+				/* The seq ids restart with the broker */
+				requests.reset();
 				clock_gettime(CLOCK_MONOTONIC, &time_t);
 				time_add_ms(&time_t, 
 					HEARTBEAT_INTERVAL + WCDPING);
@@ -183,14 +258,17 @@ void RSF_Server::step()
 		}
  
 		if (time_cmp(&tmp_t, &time_t) == 1 && reg_ok) {
-			write_log(my_name, "Broker ping timeout");
-			clock_gettime(CLOCK_MONOTONIC, &time_t);
-				time_add_ms(&time_t, 
-				HEARTBEAT_INTERVAL + WCDPING);
+			WRITE_LOG(LOG_LEVEL_WARNING, my_name, 
+				"Broker ping timeout");
+			time_copy(&time_t, &tmp_t);
+			time_add_ms(&time_t, HEARTBEAT_INTERVAL + WCDPING);
 			/* Timeout expired. It is a Ping loss from the broker */
 			if (++ping_loss == LIVENESS) {
-				write_log(my_name, "Broker dead");
-				items.erase(items.end() - 1);
+				WRITE_LOG(LOG_LEVEL_ERROR, my_name, 
+					"Broker dead");
+				items.resize(SERVICE_REQUEST_INDEX);
+				delete channel;
+				channel = NULL;
 				reg_ok = false;
 			}
 		}
@@ -200,31 +278,123 @@ void RSF_Server::step()
 /**
  * @brief Receive the request message from the broker and returns 
  * 	  the data contained inside it.
- * @param val	Reference to return the message data.
+ * @param request Where to store the message of a request, the 
+ * 	  operations are left in place
+ * @param payload Where to store the payload of a request
  * @param received_id Where to put the seq id of the received message
+ * @param client_id Where to put the identity of the client in the 
+ * 	  envelope, it is empty for a ping or a cancellation
  * 
- * @return it returns true if it is a broker ping
+ * @return it returns the type of the message
  */
 
-bool RSF_Server::receive_request(char_t *val, uint32_t* received_id)
+uint8_t RSF_Server::receive_request(std::shared_ptr<zmq::message_t> &request,
+	std::shared_ptr<payload_t> &payload, uint32_t* received_id, 
+	std::string &client_id)
 {
-	zmq::message_t msg;
+	std::vector<zmq::message_t> frames;
 	service_module sm;
+	uint32_t num_ops, data_frame;
 	
-	reply->recv(&msg);
+	/* The envelope is [client id][empty] for a request, followed by the
+	 * payload frames if any, and [empty] for the messages of the 
+	 * broker */
+	*received_id = 0;
+	client_id.clear();
+	if (channel != NULL && 
+		(items[SHM_CHANNEL_INDEX].revents & ZMQ_POLLIN)) {
+		if (!channel->recv(frames))
+			return SM_INVALID;
+	} else {
+		recv_multi_msg(reply, frames);
+	}
+	data_frame = frames.size() - 1;
+	if (frames.size() >= NUM_FRAMES) {
+		client_id.assign(static_cast<char_t*> (frames[ID_FRAME].data()),
+			frames[ID_FRAME].size());
+		data_frame = DATA_FRAME;
+	}
+	zmq::message_t &msg = frames[data_frame];
+	if (msg.size() < sizeof(service_module))
+		return SM_INVALID;
 	sm = *(static_cast<service_module *> (msg.data()));
+	if (sm.version != WIRE_VERSION)
+		return SM_INVALID;
 
-	if (sm.heartbeat == false) {
-		memcpy(val, sm.parameters, sizeof(sm.parameters));
-		std::string str(val);
-		write_log(my_name, "Received parameters " + str);
+	if (sm.type == SM_REQUEST) {
+		num_ops = ntohl(sm.num_ops);
+		if (num_ops == 0 || !wire_check_ops(
+			module_params<service_module>(msg.data()), 
+			msg.size() - sizeof(service_module), num_ops))
+			return SM_INVALID;
+		/* The thread reads the operations from the message */
+		request = std::make_shared<zmq::message_t>();
+		request->move(&msg);
+		payload = std::make_shared<payload_t>();
+		frames_to_payload(frames, data_frame + 1, *payload);
+		WRITE_LOG(LOG_LEVEL_DEBUG, my_name, "Received " + 
+			std::to_string(num_ops) + " operations");
 	}
 
 	*received_id = ntohl(sm.seq_id);
 
-	return sm.heartbeat;
+	return sm.type;
 }
 
+/**
+ * @brief Sends a message to the broker, with the envelope of a client if
+ * 	  it is the reply to a request
+ * @param client_id Identity of the client, empty for a pong
+ * @param msg Message to be sent
+ * @param payload Payload of the result, it is sent without being copied
+ */
+
+void RSF_Server::send_broker(const std::string &client_id, 
+	zmq::message_t &msg, const std::shared_ptr<payload_t> &payload)
+{
+	std::vector<zmq::message_t> frames;
+
+	if (!client_id.empty())
+		frames.push_back(zmq::message_t(client_id.data(), 
+			client_id.size()));
+	frames.push_back(zmq::message_t(EMPTY_MSG, 0));
+	frames.push_back(std::move(msg));
+	if (payload)
+		payload_to_frames(payload, frames);
+	/* The reply socket is used if the ring is full or the message is
+	 * too large for it */
+	if (channel == NULL || !channel->send(frames))
+		forward_multi_msg(reply, frames);
+}
+
+/**
+ * @brief Creates a channel in shared memory and hands it over to the 
+ * 	  broker, the messages go through the reply socket if it fails
+ */
+
+void RSF_Server::attach_channel()
+{
+	zmq::pollitem_t item;
+
+	try {
+		channel = new ShmChannel();
+	} catch (std::bad_alloc& ba) {
+		std::cerr << "bad_alloc caught: " << ba.what() << std::endl;
+		exit(EXIT_FAILURE);
+	}
+	if (!channel->create() || !channel->handover(SHM_SOCKET_PREFIX + 
+		std::to_string(broker_port), identity)) {
+		WRITE_LOG(LOG_LEVEL_WARNING, my_name, 
+			"Shared memory not available");
+		delete channel;
+		channel = NULL;
+		return;
+	}
+
+	item = {NULL, channel->get_fd(), ZMQ_POLLIN, 0};
+	items.push_back(item);
+	WRITE_LOG(LOG_LEVEL_INFO, my_name, "Attached in shared memory");
+}
 
 /**
  * @brief It sends a pong to the broker 
@@ -235,12 +405,78 @@ void RSF_Server::pong_broker()
 	server_reply_t server_reply;
 	zmq::message_t msg(sizeof(server_reply_t));
 	
-	server_reply.id = id; /* Pong from server id */
-	server_reply.service = (service_type_t) htonl((uint32_t) service_type);
+	/* Pong from server id */
+	init_server_reply(&server_reply, id, service_type, 0, 0);
 	server_reply.heartbeat = true;
 	
 	memcpy(msg.data(), (void *) &server_reply, sizeof(server_reply_t));
-	reply->send(msg);
+	send_broker("", msg);
+}
+
+/**
+ * @brief Cancels a request whose result is no longer needed by the 
+ * 	  broker, the thread elaborating it stops as soon as it checks the 
+ * 	  cancellation flag
+ * @param seq_id Seq. number of the request
+ */
+
+void RSF_Server::cancel_request(uint32_t seq_id)
+{
+	std::unordered_map<uint32_t, 
+		std::shared_ptr<std::atomic<bool>>>::iterator it = 
+		running.find(seq_id);
+
+	if (it == running.end())
+		return;
+
+	WRITE_LOG(LOG_LEVEL_INFO, my_name, "Cancelled request " + 
+		std::to_string(seq_id));
+	it->second->store(true);
+}
+
+/**
+ * @brief Sends the replies of the requests elaborated by the threads, the
+ * 	  cancelled ones are discarded
+ */
+
+void RSF_Server::send_completions()
+{
+	server_reply_t *server_reply;
+	completion_t c;
+
+	pool->clear_fd();
+	while (pool->get_completion(c)) {
+		running.erase(c.seq_id);
+		if (c.cancelled)
+			continue;
+		zmq::message_t msg(sizeof(server_reply_t) + 
+			c.results.size() * sizeof(int32_t) + 
+			(c.has_digest ? DIGEST_SIZE : 0));
+		memcpy(module_results<server_reply_t>(msg.data()), 
+			c.results.data(), c.results.size() * sizeof(int32_t));
+		/* The digest follows the result */
+		if (c.has_digest)
+			memcpy(module_results<server_reply_t>(msg.data()) + 
+				c.results.size(), c.digest.bytes, DIGEST_SIZE);
+		server_reply = static_cast<server_reply_t*> (msg.data());
+		init_server_reply(server_reply, id, service_type, c.seq_id,
+			c.results.size());
+		send_broker(c.client_id, msg, c.payload);
+	}
+}
+
+/**
+ * @brief Logs the requests waiting for a worker and the utilization of the
+ * 	  workers since the previous log
+ */
+
+void RSF_Server::log_pool()
+{
+	WRITE_LOG(LOG_LEVEL_DEBUG, my_name, "Workers " + 
+		std::to_string(pool->get_workers()) + " queue depth " + 
+		std::to_string(pool->get_queue_depth()) + " utilization " + 
+		std::to_string((int32_t) (pool->get_utilization() * 100)) + 
+		"%");
 }
 
 /**
@@ -259,42 +495,29 @@ void RSF_Server::pong_health_checker()
 	hc_pong->send(msg);
 }
 
-void task(service_thread_t st) 
-{	
-	int32_t val_elab;
-	int32_t par1;
-	server_reply_t server_reply;
-	zmq::message_t msg(sizeof(server_reply_t));
-	std::stringstream par_stream(st.parameters, std::ios_base::in);
-	
-	/* Simulate workload */
-	busy_wait(500);
-
-	deserialize(par_stream, par1);
-	
-	val_elab = st.service(par1);
-	
-	server_reply.id = st.id;
-	server_reply.heartbeat = false;
-	server_reply.result = (int32_t) htonl(val_elab);
-	server_reply.service = (service_type_t) htonl((uint32_t)
-		st.service_type);
-	server_reply.duplicated = false;
-	
-	memcpy(msg.data(), (void *) &server_reply, sizeof(server_reply_t));
-	st.skt->send(msg);
-}
-
 /**
- * @brief Spawns a thread to handle the request
- * @param parameters Service parameters
+ * @brief Submits a request to the workers
+ * @param request Message of the request
+ * @param payload Payload of the request
+ * @param seq_id Seq. number of the request
+ * @param client_id Identity of the client in the envelope of the request
  */
 
-void RSF_Server::create_thread(std::string parameters)
+void RSF_Server::submit_request(std::shared_ptr<zmq::message_t> &request, 
+	std::shared_ptr<payload_t> &payload, uint32_t seq_id, 
+	const std::string &client_id)
 {
-	service_thread.skt = reply;
-	service_thread.parameters = parameters;
+	/* The template holds the service, the job is moved to the queue */
+	service_thread_t job = service_thread;
+
+	job.request = request;
+	job.payload = payload;
+	job.num_ops = ntohl(static_cast<service_module*> (
+		request->data())->num_ops);
+	job.seq_id = seq_id;
+	job.client_id = client_id;
+	job.cancelled = std::make_shared<std::atomic<bool>>(false);
+	running[seq_id] = job.cancelled;
 	
-	std::thread(task, service_thread).detach();
+	pool->submit(job);
 }
-
@@ -14,19 +14,26 @@
 
 int32_t main(int32_t argc, char_t* argv[])
 {	
-	uint8_t service = *argv[0], id = *argv[1];
+	uint8_t service = *argv[0], id = *argv[1], group = *argv[2];
 	RSF_Server *server;
 	std::string broker_address("localhost");
 	uint16_t broker_port = REG_PORT_BROKER;
+	const char_t *busy_poll_cpu = getenv("RSF_BUSY_POLL_CPU");
+	int32_t cpu = busy_poll_cpu != NULL ? atoi(busy_poll_cpu) : 
+		SERVER_BUSY_POLL_CPU;
 
 	try {
-		server = new RSF_Server(id, service, broker_address,
+		server = new RSF_Server(id, group, service, broker_address,
 			broker_port);
 	} catch (std::bad_alloc& ba) {
 		std::cerr << "bad_alloc caught: " << ba.what() <<  std::endl;
 		exit(EXIT_FAILURE);
 	}
-	
+
+	/* The copies of a service spin on different cores */
+	if (busy_poll_cpu != NULL || SERVER_BUSY_POLL)
+		server->enable_busy_poll(cpu < 0 ? cpu : cpu + id);
+
 	server->step();	
 	
 	delete server;
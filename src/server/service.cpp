@@ -4,9 +4,6 @@
  */
 
 #include "../../include/service.hpp"
-#include <assert.h>
-#include <iostream>
-#include <stdlib.h> 
 
 /**
  * @brief It increments the value passed to the function
@@ -66,34 +63,29 @@ int32_t sum(int32_t x, int32_t y)
 }
 
 /**
- * @brief It returns the function pointer to the service
- * @param service It is the service type
- * @retval It is the function pointer to the service
+ * @brief Averages the parameters
+ * @param x First value
+ * @param y Second value
+ * @return Average of the first and the second value
  */
 
-service_body get_service_body(service_type_t service)
+float32_t average(float32_t x, float32_t y)
 {
-	service_body body;
-
-	switch (service) {
-	case INCREMENT:
-		body = &increment;
-		break;
-	case DECREMENT:
-		body = &decrement;
-		break;
-	case MULTIPLY2:
-		body = &multiply2;
-		break;
-	case SUM:
-//		body = &sum;
-		break;
-	default:
-		std::cerr << "Service not supported! Server Crash" << std::endl;
-		exit(EXIT_FAILURE);
-	}
-
-	assert(body != NULL);
-
-	return body;
-}
\ No newline at end of file
+	return (x + y) / 2;
+}
+
+/**
+ * @brief Inverts the pixels of a grayscale image tile
+ * @param tile Pixels of the tile, one byte each
+ * @return Inverted tile
+ */
+
+payload_t invert(const payload_t &tile)
+{
+	payload_t ret(tile.size(), '\0');
+
+	for (size_t i = 0; i < tile.size(); i++)
+		ret[i] = (char_t) (0xFF - (uint8_t) tile[i]);
+
+	return ret;
+}
@@ -0,0 +1,303 @@
+/*
+ *	worker_pool_class.cpp
+ *
+ */
+
+#include <iostream>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "../../include/worker_pool_class.hpp"
+#include "../../include/util.hpp"
+
+/**
+ * @brief CompletionQueue constructor, the queue starts with the stub node
+ */
+
+CompletionQueue::CompletionQueue()
+{
+	completion_node_t *stub = new completion_node_t();
+
+	stub->next.store(NULL, std::memory_order_relaxed);
+	this->head.store(stub, std::memory_order_relaxed);
+	this->tail = stub;
+}
+
+/**
+ * @brief CompletionQueue destructor, it must be called when the producers
+ * 	  have stopped
+ */
+
+CompletionQueue::~CompletionQueue()
+{
+	completion_node_t *next;
+
+	while (tail != NULL) {
+		next = tail->next.load(std::memory_order_relaxed);
+		delete tail;
+		tail = next;
+	}
+}
+
+/**
+ * @brief Pushes a completion, it is called by any worker
+ * @param completion Completion, its content is moved into the queue
+ */
+
+void CompletionQueue::push(completion_t &completion)
+{
+	completion_node_t *node = new completion_node_t();
+	completion_node_t *prev;
+
+	node->completion = std::move(completion);
+	node->next.store(NULL, std::memory_order_relaxed);
+	/* The node is visible to the consumer once it is linked */
+	prev = head.exchange(node, std::memory_order_acq_rel);
+	prev->next.store(node, std::memory_order_release);
+}
+
+/**
+ * @brief Pops the oldest completion, it is called by the main thread only.
+ * 	  A completion whose node is not linked yet is popped at the next
+ * 	  call.
+ * @param completion Where to move the completion
+ * @return It returns false if the queue is empty
+ */
+
+bool CompletionQueue::pop(completion_t &completion)
+{
+	completion_node_t *next = tail->next.load(std::memory_order_acquire);
+
+	if (next == NULL)
+		return false;
+
+	/* The popped node becomes the stub */
+	completion = std::move(next->completion);
+	delete tail;
+	tail = next;
+
+	return true;
+}
+
+/**
+ * @brief Elaborates a request, every operation of the batch is executed
+ * 	  and the results are collected in a single completion. The
+ * 	  elaboration stops if the request is cancelled.
+ * @param st Request to be elaborated
+ * @param completion Where to store the results
+ */
+
+static void elaborate(service_thread_t &st, completion_t &completion)
+{
+	int32_t result;
+	wire_reader_t ops, op;
+	payload_t out;
+
+	completion.seq_id = st.seq_id;
+	completion.client_id = st.client_id;
+
+	/* Simulate workload */
+	for (uint32_t t = 0; t < WORKLOAD_MS && !st.cancelled->load();
+		t += CANCEL_CHECK_MS)
+		busy_wait(CANCEL_CHECK_MS);
+
+	/* The operations have been checked when received */
+	ops.pos = module_params<service_module>(st.request->data());
+	ops.end = static_cast<uint8_t*> (st.request->data()) +
+		st.request->size();
+	for (uint32_t i = 0; i < st.num_ops && !st.cancelled->load(); i++) {
+		wire_next_op(ops, op);
+		/* The broker checks the parameters against the signature of
+		 * the service, a request that doesn't match is not answered
+		 * rather than with a result that has not been computed */
+		if (!st.service(op, *st.payload, result, out)) {
+			completion.cancelled = true;
+			return;
+		}
+		completion.results.push_back(result);
+	}
+	/* A payload is returned for a single operation only, the copies
+	 * are voted on its digest */
+	completion.has_digest = st.num_ops == 1 &&
+		service_returns_payload(st.service_type);
+	if (completion.has_digest) {
+		compute_digest(out.data(), out.size(), completion.digest);
+		if (!out.empty())
+			completion.payload = std::make_shared<payload_t>(
+				std::move(out));
+	}
+	completion.cancelled = st.cancelled->load();
+}
+
+/**
+ * @brief WorkerPool constructor, it starts the workers
+ * @param num_workers Number of workers, 0 for one for each core
+ */
+
+WorkerPool::WorkerPool(uint32_t num_workers)
+{
+	this->stopping = false;
+	this->busy_us.store(0);
+	this->last_busy_us = 0;
+	clock_gettime(CLOCK_MONOTONIC, &this->last_sample);
+	this->notify_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (this->notify_fd < 0) {
+		std::cerr << "Error creating the eventfd" << std::endl;
+		exit(EXIT_FAILURE);
+	}
+
+	if (num_workers == 0)
+		num_workers = std::thread::hardware_concurrency();
+	if (num_workers == 0)
+		num_workers = 1;
+	for (uint32_t i = 0; i < num_workers; i++)
+		workers.push_back(std::thread(&WorkerPool::worker, this));
+}
+
+/**
+ * @brief WorkerPool destructor, the workers finish the requests they are
+ * 	  elaborating and the waiting ones are dropped
+ */
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+		jobs.clear();
+	}
+	available.notify_all();
+	for (uint32_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+	close(notify_fd);
+}
+
+/**
+ * @brief Body of a worker, it elaborates the requests in arrival order
+ */
+
+void WorkerPool::worker()
+{
+	service_thread_t job;
+	completion_t completion;
+	struct timespec start, end;
+	uint64_t event = 1;
+
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			while (jobs.empty() && !stopping)
+				available.wait(lock);
+			if (stopping)
+				return;
+			job = std::move(jobs.front());
+			jobs.pop_front();
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		completion = completion_t();
+		elaborate(job, completion);
+		/* The messages of the request are released by the worker */
+		job = service_thread_t();
+		completions.push(completion);
+		if (write(notify_fd, &event, sizeof(event)) != sizeof(event))
+			std::cerr << "Error notifying a completion" << std::endl;
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		busy_us.fetch_add((end.tv_sec - start.tv_sec) * 1000000 +
+			(end.tv_nsec - start.tv_nsec) / 1000,
+			std::memory_order_relaxed);
+	}
+}
+
+/**
+ * @brief Queues a request for the workers
+ * @param job Request, its content is moved into the queue
+ */
+
+void WorkerPool::submit(service_thread_t &job)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.push_back(std::move(job));
+	}
+	available.notify_one();
+}
+
+/**
+ * @brief Gets a request elaborated by the workers, it is called by the
+ * 	  main thread only
+ * @param completion Where to store the completion
+ * @return It returns false if no request has been elaborated
+ */
+
+bool WorkerPool::get_completion(completion_t &completion)
+{
+	return completions.pop(completion);
+}
+
+/**
+ * @brief Gets the descriptor that becomes readable when a request has 
+ * 	  been elaborated, it can be polled with the sockets
+ */
+
+int32_t WorkerPool::get_fd()
+{
+	return notify_fd;
+}
+
+/**
+ * @brief Clears the notifications, it must be called before the 
+ * 	  completions are taken so that a later one is not missed
+ */
+
+void WorkerPool::clear_fd()
+{
+	uint64_t events;
+
+	if (read(notify_fd, &events, sizeof(events)) < 0)
+		return;
+}
+
+/**
+ * @brief Gets the number of requests waiting for a worker
+ */
+
+uint32_t WorkerPool::get_queue_depth()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	return jobs.size();
+}
+
+/**
+ * @brief Gets the number of workers
+ */
+
+uint32_t WorkerPool::get_workers()
+{
+	return workers.size();
+}
+
+/**
+ * @brief Gets the fraction of time the workers have been busy since the
+ * 	  previous call, a request is accounted when it is completed
+ * @return It returns the utilization in [0, 1]
+ */
+
+double WorkerPool::get_utilization()
+{
+	struct timespec now;
+	uint64_t busy = busy_us.load(std::memory_order_relaxed);
+	double elapsed_us, utilization = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	elapsed_us = (now.tv_sec - last_sample.tv_sec) * 1e6 +
+		(now.tv_nsec - last_sample.tv_nsec) / 1e3;
+	if (elapsed_us > 0)
+		utilization = (busy - last_busy_us) /
+			(elapsed_us * workers.size());
+	last_busy_us = busy;
+	last_sample = now;
+
+	return utilization < 1 ? utilization : 1;
+}
@@ -0,0 +1,256 @@
+/*
+ *	logger_class.cpp
+ *
+ */
+
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#include <sys/stat.h>
+#include "../../include/logger_class.hpp"
+
+/**
+ * @brief Gets the initial level of the rows written, from the environment
+ */
+
+static uint8_t initial_log_level()
+{
+	const char_t *level = getenv(LOG_LEVEL_ENV);
+
+	if (level == NULL)
+		return LOG_LEVEL_MAX;
+
+	return atoi(level);
+}
+
+std::atomic<uint8_t> log_level(initial_log_level());
+
+/**
+ * @brief Logger constructor, it starts the flusher
+ */
+
+Logger::Logger()
+{
+	this->stopping.store(false);
+	this->flusher = std::thread(&Logger::run, this);
+}
+
+/**
+ * @brief Logger destructor, the rows still in the rings are flushed
+ */
+
+Logger::~Logger()
+{
+	stopping.store(true);
+	wake.notify_one();
+	flusher.join();
+	flush();
+
+#ifndef CONSOLE_LOG
+	for (auto &it : files)
+		fclose(it.second);
+#endif
+}
+
+/**
+ * @brief Gets the logger of the process, it is created at the first row
+ */
+
+Logger &Logger::instance()
+{
+	static Logger logger;
+
+	return logger;
+}
+
+/**
+ * @brief Gets the ring of the calling thread, it is created at the first
+ * 	  row of the thread
+ */
+
+log_ring_t *Logger::get_ring()
+{
+	static thread_local log_ring_t *ring = NULL;
+	void *memory;
+
+	if (ring != NULL)
+		return ring;
+
+	/* The counters are kept on their own cache lines */
+	if (posix_memalign(&memory, alignof(log_ring_t), 
+		sizeof(log_ring_t)) != 0) {
+		std::cerr << "Error allocating the log ring" << std::endl;
+		exit(EXIT_FAILURE);
+	}
+	ring = new (memory) log_ring_t();
+	ring->head.store(0);
+	ring->tail.store(0);
+	ring->dropped.store(0);
+	std::lock_guard<std::mutex> lock(rings_mutex);
+	rings.push_back(ring);
+
+	return ring;
+}
+
+/**
+ * @brief Writes a row in the ring of the calling thread, it never blocks
+ * @param level Level of the row
+ * @param who Writer of the row, it names the file
+ * @param what Text of the row
+ */
+
+void Logger::write(uint8_t level, const std::string &who,
+	const std::string &what)
+{
+	log_ring_t *ring;
+	uint32_t tail, used;
+	log_entry_t *entry;
+
+	/* The rows written while the process exits are lost */
+	if (stopping.load(std::memory_order_relaxed))
+		return;
+	ring = get_ring();
+	tail = ring->tail.load(std::memory_order_relaxed);
+	used = tail - ring->head.load(std::memory_order_acquire);
+	if (used == LOG_RING_SLOTS) {
+		ring->dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	entry = &ring->entries[tail % LOG_RING_SLOTS];
+	clock_gettime(CLOCK_REALTIME, &entry->time);
+	entry->level = level;
+	entry->who_len = who.copy(entry->who, LOG_WHO_SIZE);
+	entry->what_len = what.copy(entry->what, LOG_WHAT_SIZE);
+	/* The row is visible to the flusher once the tail is updated */
+	ring->tail.store(tail + 1, std::memory_order_release);
+
+	/* The flusher is anticipated before the ring fills up */
+	if (used + 1 == LOG_RING_SLOTS / 2)
+		wake.notify_one();
+}
+
+/**
+ * @brief Gets the file of a writer, it is opened at its first row
+ * @param who Writer
+ * @return It returns the file, NULL if it can't be opened
+ */
+
+FILE *Logger::get_file(const std::string &who)
+{
+	std::unordered_map<std::string, FILE*>::iterator it = files.find(who);
+	FILE *file;
+
+	if (it != files.end())
+		return it->second;
+
+#ifdef CONSOLE_LOG
+	file = stdout;
+#else
+	struct stat sb;
+
+	/* Check if the 'log/' directory already exists */
+	if (stat("log/", &sb) != 0 || !S_ISDIR(sb.st_mode))
+		mkdir("log/", 0777);
+	file = fopen(("log/" + who + ".txt").c_str(), "a");
+	if (file == NULL) {
+		std::cerr << "Error opening the log of " << who << std::endl;
+		return NULL;
+	}
+#endif
+	files[who] = file;
+
+	return file;
+}
+
+/**
+ * @brief Formats and writes the rows in the rings, then the files are
+ * 	  flushed
+ */
+
+void Logger::flush()
+{
+	std::vector<log_ring_t*> snapshot;
+	uint32_t head, tail;
+	uint64_t dropped;
+	log_entry_t *entry;
+	std::string who;
+	tm now_tm;
+	FILE *file;
+
+	{
+		std::lock_guard<std::mutex> lock(rings_mutex);
+		snapshot = rings;
+	}
+
+	for (uint32_t i = 0; i < snapshot.size(); i++) {
+		head = snapshot[i]->head.load(std::memory_order_relaxed);
+		tail = snapshot[i]->tail.load(std::memory_order_acquire);
+		for (; head != tail; head++) {
+			entry = &snapshot[i]->entries[head % LOG_RING_SLOTS];
+			who.assign(entry->who, entry->who_len);
+			file = get_file(who);
+			if (file == NULL)
+				continue;
+			localtime_r(&entry->time.tv_sec, &now_tm);
+			fprintf(file, "%d-%d-%d_%d:%d:%d.%d %s %.*s\n",
+				now_tm.tm_year + ABS_YEAR, now_tm.tm_mon + 1,
+				now_tm.tm_mday, now_tm.tm_hour, now_tm.tm_min,
+				now_tm.tm_sec, (int32_t) (entry->time.tv_nsec /
+				1000000), who.c_str(), (int32_t) entry->what_len,
+				entry->what);
+		}
+		/* The rows are given back to the thread */
+		snapshot[i]->head.store(head, std::memory_order_release);
+
+		dropped = snapshot[i]->dropped.exchange(0,
+			std::memory_order_relaxed);
+		if (dropped > 0)
+			std::cerr << "Log: " << dropped << " rows dropped" <<
+				std::endl;
+	}
+
+	for (auto &it : files)
+		fflush(it.second);
+}
+
+/**
+ * @brief Body of the flusher, it flushes the rings every LOG_FLUSH_MS or
+ * 	  when a ring is half full
+ */
+
+void Logger::run()
+{
+	while (!stopping.load()) {
+		{
+			std::unique_lock<std::mutex> lock(wake_mutex);
+			wake.wait_for(lock,
+				std::chrono::milliseconds(LOG_FLUSH_MS));
+		}
+		flush();
+	}
+}
+
+/**
+ * @brief Sets the level of the rows written, the rows above LOG_LEVEL_MAX
+ * 	  are never written
+ * @param level Level
+ */
+
+void set_log_level(uint8_t level)
+{
+	log_level.store(level, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Writes a log row, WRITE_LOG should be used to filter it by level
+ * @param level Level of the row
+ * @param who String representing who is writing the log row
+ * @param what Information to log
+ */
+
+void write_log(uint8_t level, const std::string &who, const std::string &what)
+{
+	Logger::instance().write(level, who, what);
+}
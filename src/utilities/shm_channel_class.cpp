@@ -0,0 +1,333 @@
+/*
+ *	shm_channel_class.cpp
+ *
+ */
+
+#include <iostream>
+#include <new>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "../../include/shm_channel_class.hpp"
+
+/**
+ * @brief ShmChannel constructor, the channel is created or attached later
+ */
+
+ShmChannel::ShmChannel()
+{
+	this->segment = NULL;
+	for (uint8_t i = 0; i < SHM_NUM_FDS; i++)
+		this->fds[i] = -1;
+	this->tx = SHM_TO_BROKER;
+	this->rx = SHM_TO_SERVER;
+}
+
+/**
+ * @brief ShmChannel destructor, the memory is released when both sides
+ * 	  have closed it
+ */
+
+ShmChannel::~ShmChannel()
+{
+	if (segment != NULL)
+		munmap(segment, sizeof(shm_segment_t));
+	for (uint8_t i = 0; i < SHM_NUM_FDS; i++)
+		if (fds[i] >= 0)
+			close(fds[i]);
+}
+
+/**
+ * @brief Maps the shared memory of the channel
+ * @return It returns false if the memory can't be mapped
+ */
+
+bool ShmChannel::map()
+{
+	void *addr = mmap(NULL, sizeof(shm_segment_t), PROT_READ | PROT_WRITE,
+		MAP_SHARED, fds[0], 0);
+
+	if (addr == MAP_FAILED) {
+		std::cerr << "Error mapping the channel" << std::endl;
+		return false;
+	}
+	segment = static_cast<shm_segment_t*> (addr);
+
+	return true;
+}
+
+/**
+ * @brief Creates the channel on the side of the server copy
+ * @return It returns false if the channel can't be created
+ */
+
+bool ShmChannel::create()
+{
+	fds[0] = memfd_create("rsf_shm", MFD_CLOEXEC);
+	if (fds[0] < 0 || ftruncate(fds[0], sizeof(shm_segment_t)) < 0) {
+		std::cerr << "Error creating the channel" << std::endl;
+		return false;
+	}
+	for (uint8_t i = 1; i < SHM_NUM_FDS; i++) {
+		fds[i] = eventfd(0, EFD_SEMAPHORE | EFD_NONBLOCK | EFD_CLOEXEC);
+		if (fds[i] < 0) {
+			std::cerr << "Error creating the eventfd" << std::endl;
+			return false;
+		}
+	}
+	if (!map())
+		return false;
+	for (uint8_t i = 0; i < 2; i++) {
+		new (&segment->rings[i].head) std::atomic<uint64_t>(0);
+		new (&segment->rings[i].tail) std::atomic<uint64_t>(0);
+	}
+	tx = SHM_TO_BROKER;
+	rx = SHM_TO_SERVER;
+
+	return true;
+}
+
+/**
+ * @brief Attaches the broker to the channel created by a server copy
+ * @param fds Descriptors received with the handover, they are owned by
+ * 	  the channel
+ * @return It returns false if the channel can't be mapped
+ */
+
+bool ShmChannel::attach(const int32_t *fds)
+{
+	for (uint8_t i = 0; i < SHM_NUM_FDS; i++)
+		this->fds[i] = fds[i];
+	tx = SHM_TO_SERVER;
+	rx = SHM_TO_BROKER;
+
+	return map();
+}
+
+/**
+ * @brief Hands the descriptors of the channel over to the broker
+ * @param path Path of the unix socket of the broker
+ * @param identity Identity of the copy, the broker finds the copy by it
+ * @return It returns false if the broker can't be reached
+ */
+
+bool ShmChannel::handover(const std::string &path, const std::string &identity)
+{
+	struct sockaddr_un addr;
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	char_t control[CMSG_SPACE(sizeof(fds))];
+	int32_t skt;
+	bool ret;
+
+	skt = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (skt < 0)
+		return false;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+	if (connect(skt, (struct sockaddr*) &addr, sizeof(addr)) < 0) {
+		close(skt);
+		return false;
+	}
+
+	/* The identity is the data, the descriptors are the ancillary data */
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = (void*) identity.data();
+	iov.iov_len = identity.size();
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+	ret = sendmsg(skt, &msg, 0) == (ssize_t) identity.size();
+	close(skt);
+
+	return ret;
+}
+
+/**
+ * @brief Writes a message in the ring of this side and wakes up the
+ * 	  reader. The frames are copied, they are kept by the caller.
+ * @param frames Frames of the message
+ * @return It returns false if the ring is full or a frame is larger than
+ * 	   half of the ring, nothing is written and the caller can send
+ * 	   the message in another way
+ */
+
+bool ShmChannel::send(std::vector<zmq::message_t> &frames)
+{
+	shm_ring_t *ring = &segment->rings[tx];
+	uint64_t head = ring->head.load(std::memory_order_acquire);
+	uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+	uint64_t pos = tail, offset, length, event = 1;
+	uint32_t header[2];
+
+	for (uint32_t i = 0; i < frames.size(); i++) {
+		length = SHM_FRAME_HEADER + ((frames[i].size() + SHM_ALIGN - 1) &
+			~((uint64_t) SHM_ALIGN - 1));
+		if (length > SHM_RING_SIZE / 2)
+			return false;
+		offset = pos % SHM_RING_SIZE;
+		/* A frame is never split, the reader goes back to the start
+		 * of the ring */
+		if (offset + length > SHM_RING_SIZE) {
+			if (pos + SHM_RING_SIZE - offset + length - head >
+				SHM_RING_SIZE)
+				return false;
+			header[0] = SHM_WRAP;
+			memcpy(ring->data + offset, header, sizeof(header[0]));
+			pos += SHM_RING_SIZE - offset;
+			offset = 0;
+		}
+		if (pos + length - head > SHM_RING_SIZE)
+			return false;
+		header[0] = frames[i].size();
+		header[1] = i < frames.size() - 1 ? SHM_MORE : 0;
+		memcpy(ring->data + offset, header, sizeof(header));
+		memcpy(ring->data + offset + SHM_FRAME_HEADER,
+			frames[i].data(), frames[i].size());
+		pos += length;
+	}
+
+	/* The message is visible to the reader once the tail is updated */
+	ring->tail.store(pos, std::memory_order_release);
+	/* The message is in the ring anyway, it is read at the next wake up */
+	if (write(fds[1 + tx], &event, sizeof(event)) != sizeof(event))
+		std::cerr << "Error notifying the channel" << std::endl;
+
+	return true;
+}
+
+/**
+ * @brief Reads a message from the ring of the other side, the eventfd is
+ * 	  decremented once for each message
+ * @param frames Where to store the frames of the message
+ * @return It returns false if there are no messages
+ */
+
+bool ShmChannel::recv(std::vector<zmq::message_t> &frames)
+{
+	shm_ring_t *ring = &segment->rings[rx];
+	uint64_t pos, tail, offset, event;
+	uint32_t header[2];
+
+	if (read(fds[1 + rx], &event, sizeof(event)) != sizeof(event))
+		return false;
+	pos = ring->head.load(std::memory_order_relaxed);
+	tail = ring->tail.load(std::memory_order_acquire);
+	frames.clear();
+	header[1] = SHM_MORE;
+	while (pos != tail && (header[1] & SHM_MORE)) {
+		offset = pos % SHM_RING_SIZE;
+		memcpy(header, ring->data + offset, sizeof(header[0]));
+		if (header[0] == SHM_WRAP) {
+			pos += SHM_RING_SIZE - offset;
+			header[1] = SHM_MORE;
+			continue;
+		}
+		memcpy(header, ring->data + offset, sizeof(header));
+		frames.push_back(zmq::message_t(ring->data + offset +
+			SHM_FRAME_HEADER, header[0]));
+		pos += SHM_FRAME_HEADER + ((header[0] + SHM_ALIGN - 1) &
+			~((uint64_t) SHM_ALIGN - 1));
+	}
+	/* The space is given back to the writer */
+	ring->head.store(pos, std::memory_order_release);
+
+	return !frames.empty();
+}
+
+/**
+ * @brief Gets the descriptor to be polled for the incoming messages
+ */
+
+int32_t ShmChannel::get_fd()
+{
+	return fds[1 + rx];
+}
+
+/**
+ * @brief Creates the unix socket where the broker receives the handovers
+ * 	  of the channels
+ * @param path Path of the socket
+ * @return It returns the descriptor of the socket, -1 on error
+ */
+
+int32_t shm_listen(const std::string &path)
+{
+	struct sockaddr_un addr;
+	int32_t skt;
+
+	skt = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (skt < 0)
+		return -1;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+	/* The socket of a previous run is replaced */
+	unlink(path.c_str());
+	if (bind(skt, (struct sockaddr*) &addr, sizeof(addr)) < 0 ||
+		listen(skt, SOMAXCONN) < 0) {
+		std::cerr << "Error binding " << path << std::endl;
+		close(skt);
+		return -1;
+	}
+
+	return skt;
+}
+
+/**
+ * @brief Receives the handover of a channel from a server copy
+ * @param listener Socket created by shm_listen()
+ * @param identity Where to store the identity of the copy
+ * @param fds Where to store the SHM_NUM_FDS descriptors of the channel
+ * @return It returns false if no valid handover has been received
+ */
+
+bool shm_accept(int32_t listener, std::string &identity, int32_t *fds)
+{
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	struct timeval timeout = {0, 500000};
+	char_t control[CMSG_SPACE(SHM_NUM_FDS * sizeof(int32_t))];
+	char_t buffer[256];
+	ssize_t len;
+	int32_t skt;
+
+	skt = accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+	if (skt < 0)
+		return false;
+	/* The copy sends the handover as soon as it is connected */
+	setsockopt(skt, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = buffer;
+	iov.iov_len = sizeof(buffer);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+	len = recvmsg(skt, &msg, MSG_CMSG_CLOEXEC);
+	close(skt);
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	if (len <= 0 || cmsg == NULL || cmsg->cmsg_type != SCM_RIGHTS ||
+		cmsg->cmsg_len != CMSG_LEN(SHM_NUM_FDS * sizeof(int32_t)))
+		return false;
+	memcpy(fds, CMSG_DATA(cmsg), SHM_NUM_FDS * sizeof(int32_t));
+	identity.assign(buffer, len);
+
+	return true;
+}
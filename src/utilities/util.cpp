@@ -9,9 +9,7 @@
 #include <ctype.h>
 #include <zmq.hpp>
 #include <iostream>
-#include <fstream>
 #include <time.h>
-#include <sys/stat.h>
 #include "../../include/util.hpp"
 #include "../../include/communication.hpp"
 
@@ -22,11 +20,13 @@
  * @param num_cp_server Where to store the number of copies of a server
  * @param service Where to store the number of service to be deployed
  * @param num_options Number of options expected
+ * @param num_groups Where to store the optional number of groups, NULL
+ * 	  if the option is not accepted
  * @return None
  */
 
 void get_arg(int32_t argc, char_t *argv[], uint8_t &num_cp_server,
-	uint8_t &service, char_t num_options)
+	uint8_t &service, char_t num_options, uint8_t *num_groups)
 {
 	char_t c;
 	uint8_t cnt_options = 0;
@@ -35,7 +35,8 @@ void get_arg(int32_t argc, char_t *argv[], uint8_t &num_cp_server,
 		fprintf(stderr, "Mandatory argument missing!\n");
 		exit(EXIT_FAILURE);
 	}
-	while ((c = getopt(argc, argv, "s:n:")) != -1) {
+	while ((c = getopt(argc, argv, num_groups != NULL ? "s:n:g:" : 
+		"s:n:")) != -1) {
 
 		cnt_options++;
 
@@ -43,6 +44,11 @@ void get_arg(int32_t argc, char_t *argv[], uint8_t &num_cp_server,
 		case 'n':
 			num_cp_server = atoi(optarg);
 			break;
+		case 'g':
+			/* Optional, it is not counted */
+			*num_groups = atoi(optarg);
+			cnt_options--;
+			break;
 		case 's':
 			service = atoi(optarg);
 			break;
@@ -131,10 +137,71 @@ void get_arg(int32_t argc, char_t *argv[], service_type_t &service,
 
 zmq::socket_t* add_socket(zmq::context_t *ctx, std::string addr, uint16_t port,
 	int32_t skt_type, uint8_t dir)
+{
+	return add_socket(ctx, addr, port, skt_type, dir, "");
+}
+
+/**
+ * @brief Adds a socket with an identity to the actual context, a ROUTER 
+ * 	  peer can address it by its identity
+ * @param ctx Pointer to the actual context
+ * @param addr Address of the socket
+ * @param port Port of the socket
+ * @param skt_type Type of the socket (ZMQ_REP, ZMQ_REQ, etc.)
+ * @param dir Direction of the communication (CONNECT or BIND)
+ * @param identity Identity of the socket, if empty it is chosen by ZMQ
+ * @return Pointer to the created socket
+ */
+
+zmq::socket_t* add_socket(zmq::context_t *ctx, std::string addr, uint16_t port,
+	int32_t skt_type, uint8_t dir, const std::string &identity)
+{
+	std::string conf;
+
+	if (port != 0)
+		conf = transport_endpoint(TRANSPORT_TCP, addr, port);
+	else
+		conf = (IPC_PROTOCOL + addr);
+
+	return add_endpoint_socket(ctx, conf, skt_type, dir, identity);
+}
+
+/**
+ * @brief Builds the endpoint of a socket for a transport
+ * @param transport Transport (TRANSPORT_TCP, TRANSPORT_IPC, etc.)
+ * @param addr Address of the socket, not used by the local transports
+ * @param port Port of the socket, it names the local endpoints
+ * @return It returns the endpoint
+ */
+
+std::string transport_endpoint(uint8_t transport, std::string addr, 
+	uint16_t port)
+{
+	switch (transport) {
+	case TRANSPORT_IPC:
+	case TRANSPORT_SHM:
+		return IPC_PROTOCOL + std::string(IPC_PATH_PREFIX) + 
+			std::to_string(port);
+	default:
+		return TCP_PROTOCOL + addr + ":" + std::to_string(port);
+	}
+}
+
+/**
+ * @brief Adds a socket bound or connected to an endpoint
+ * @param ctx Pointer to the actual context
+ * @param endpoint Endpoint of the socket
+ * @param skt_type Type of the socket (ZMQ_REP, ZMQ_REQ, etc.)
+ * @param dir Direction of the communication (CONNECT or BIND)
+ * @param identity Identity of the socket, if empty it is chosen by ZMQ
+ * @return Pointer to the created socket
+ */
+
+zmq::socket_t* add_endpoint_socket(zmq::context_t *ctx, 
+	const std::string &endpoint, int32_t skt_type, uint8_t dir, 
+	const std::string &identity)
 {
 	zmq::socket_t *skt;
-	std::string p, conf;
-	char_t str[MAX_LENGTH_STRING_PORT];
 	
 	/* Create the ZMQ socket */
 	try {
@@ -144,14 +211,42 @@ zmq::socket_t* add_socket(zmq::context_t *ctx, std::string addr, uint16_t port,
 		exit(EXIT_FAILURE);
 	}
 
-	memset(str, '\0', MAX_LENGTH_STRING_PORT);
-	sprintf(str, "%d", port);
-	p.assign(str);
-	
-	if (port != 0)
-		conf = (TCP_PROTOCOL + addr + ":" + p);
+	/* The identity must be set before connecting */
+	if (!identity.empty())
+		skt->setsockopt(ZMQ_IDENTITY, identity.data(), 
+			identity.size());
+
+	if (dir == BIND)
+		skt->bind(endpoint.c_str());
 	else
-		conf = (IPC_PROTOCOL + addr);
+		skt->connect(endpoint.c_str());
+	
+	return skt; 
+}
+
+/**
+ * @brief Adds a socket for the communication among threads of a process
+ * @param ctx Pointer to the context shared by the threads
+ * @param name Name of the endpoint
+ * @param skt_type Type of the socket (ZMQ_PAIR, ZMQ_DEALER, etc.)
+ * @param dir Direction of the communication (CONNECT or BIND), the bind 
+ * 	  must be done before the connect
+ * @return Pointer to the created socket
+ */
+
+zmq::socket_t* add_inproc_socket(zmq::context_t *ctx, std::string name, 
+	int32_t skt_type, uint8_t dir)
+{
+	zmq::socket_t *skt;
+	std::string conf = INPROC_PROTOCOL + name;
+
+	/* Create the ZMQ socket */
+	try {
+		skt = new zmq::socket_t(*ctx, skt_type);
+	} catch (std::bad_alloc& ba) {
+		std::cerr << "bad_alloc caught: " << ba.what() << std::endl;
+		exit(EXIT_FAILURE);
+	}
 
 	if (dir == BIND)
 		skt->bind(conf.c_str());
@@ -162,27 +257,232 @@ zmq::socket_t* add_socket(zmq::context_t *ctx, std::string addr, uint16_t port,
 }
 
 /**
- * @brief Sends a message composed by multiple frames
+ * @brief Sends a message composed by multiple frames, the frames are kept.
+ * 	  The large frames are shared with the sent message by reference, 
+ * 	  so a payload sent to several sockets is not copied.
  * @param skt Socket used to send the messages
  * @param msg Vector containing the messages to be sent
  */
  
 void send_multi_msg(zmq::socket_t *skt, std::vector<zmq::message_t> &msg)
 {
-	uint8_t i;
+	uint32_t i;
 	zmq::message_t tmp;
 	
 	for (i = 0; i < msg.size() - 1; i++) {
-		tmp.rebuild(msg[i].data(), msg[i].size());
+		tmp.copy(&msg[i]);
 		skt->send(tmp, ZMQ_SNDMORE | ZMQ_DONTWAIT);
 	}
 
 	/* Last message in the sequence */
-	tmp.rebuild(msg[i].data(), msg[i].size());
+	tmp.copy(&msg[i]);
 	skt->send(tmp, 0 | ZMQ_DONTWAIT);
 }
 
+/**
+ * @brief Receives all the frames of a message
+ * @param skt Socket used to receive the message
+ * @param msg Vector where to store the frames, it is resized to the 
+ * 	  number of frames
+ */
+
+void recv_multi_msg(zmq::socket_t *skt, std::vector<zmq::message_t> &msg)
+{
+	int32_t more;
+	size_t more_size;
+	uint32_t i = 0;
 
+	do {
+		if (i == msg.size())
+			msg.resize(i + 1);
+		skt->recv(&msg[i++]);
+		more_size = sizeof(more);
+		skt->getsockopt(ZMQ_RCVMORE, &more, &more_size);
+	} while (more);
+
+	msg.resize(i);
+}
+
+/**
+ * @brief Answers a client with a status and no results, the envelope of the
+ * 	  request is kept and its other frames are replaced
+ * @param skt ROUTER socket of the clients
+ * @param msg Frames of the request, the identity of the client first
+ * @param status Status of the response
+ * @param request_id Identifier of the client request, 0 if unknown
+ */
+
+void reply_status(zmq::socket_t *skt, std::vector<zmq::message_t> &msg,
+	service_status_t status, uint32_t request_id)
+{
+	response_module response;
+
+	/* Nobody can be answered without the identity */
+	if (msg.empty() || msg[ID_FRAME].size() == 0)
+		return;
+	init_response_module(&response, status, request_id, 0);
+	msg.resize(NUM_FRAMES);
+	msg[EMPTY_FRAME].rebuild(EMPTY_MSG, 0);
+	msg[DATA_FRAME].rebuild((void*) &response, sizeof(response_module));
+	forward_multi_msg(skt, msg);
+}
+
+/**
+ * @brief Sends a message composed by multiple frames without copying them,
+ * 	  after the call the frames are empty
+ * @param skt Socket used to send the messages
+ * @param msg Vector containing the messages to be sent
+ */
+
+void forward_multi_msg(zmq::socket_t *skt, std::vector<zmq::message_t> &msg)
+{
+	for (uint32_t i = 0; i < msg.size(); i++)
+		skt->send(msg[i], (i < msg.size() - 1 ? ZMQ_SNDMORE : 0) | 
+			ZMQ_DONTWAIT);
+}
+
+/**
+ * @brief Releases the reference of a frame to its payload
+ * @param data Data of the frame
+ * @param hint Reference to the payload
+ */
+
+static void release_payload(void *data, void *hint)
+{
+	delete static_cast<std::shared_ptr<payload_t>*> (hint);
+}
+
+/**
+ * @brief Appends a payload to a message as frames of at most 
+ * 	  PAYLOAD_CHUNK_SIZE bytes. The frames reference the payload, that
+ * 	  is released when the last of them has been sent.
+ * @param payload Payload to be sent
+ * @param msg Frames of the message
+ */
+
+void payload_to_frames(const std::shared_ptr<payload_t> &payload, 
+	std::vector<zmq::message_t> &msg)
+{
+	size_t len;
+
+	for (size_t offset = 0; offset < payload->size(); 
+		offset += PAYLOAD_CHUNK_SIZE) {
+		len = payload->size() - offset < PAYLOAD_CHUNK_SIZE ? 
+			payload->size() - offset : PAYLOAD_CHUNK_SIZE;
+		msg.push_back(zmq::message_t(&(*payload)[offset], len, 
+			release_payload, new std::shared_ptr<payload_t>(
+			payload)));
+	}
+}
+
+/**
+ * @brief Appends a copy of a payload to a message as frames of at most 
+ * 	  PAYLOAD_CHUNK_SIZE bytes
+ * @param payload Payload to be sent
+ * @param msg Frames of the message
+ */
+
+void payload_copy_to_frames(const payload_t &payload, 
+	std::vector<zmq::message_t> &msg)
+{
+	size_t len;
+
+	for (size_t offset = 0; offset < payload.size(); 
+		offset += PAYLOAD_CHUNK_SIZE) {
+		len = payload.size() - offset < PAYLOAD_CHUNK_SIZE ? 
+			payload.size() - offset : PAYLOAD_CHUNK_SIZE;
+		msg.push_back(zmq::message_t(payload.data() + offset, len));
+	}
+}
+
+/**
+ * @brief Joins the payload frames of a message
+ * @param msg Frames of the message
+ * @param first Index of the first payload frame
+ * @param payload Where to store the payload
+ */
+
+void frames_to_payload(std::vector<zmq::message_t> &msg, uint32_t first,
+	payload_t &payload)
+{
+	size_t size = 0;
+
+	for (uint32_t i = first; i < msg.size(); i++)
+		size += msg[i].size();
+	payload.clear();
+	payload.reserve(size);
+	for (uint32_t i = first; i < msg.size(); i++)
+		payload.append(static_cast<char_t*> (msg[i].data()), 
+			msg[i].size());
+}
+
+static inline uint64_t rotl64(uint64_t x, int8_t r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t fmix64(uint64_t k)
+{
+	k ^= k >> 33;
+	k *= 0xff51afd7ed558ccdULL;
+	k ^= k >> 33;
+	k *= 0xc4ceb9fe1a85ec53ULL;
+	k ^= k >> 33;
+
+	return k;
+}
+
+/**
+ * @brief Computes the 128 bit digest of a buffer (MurmurHash3 x64 128), 
+ * 	  the copies of a server agree on a payload if they agree on its 
+ * 	  digest
+ * @param data Buffer
+ * @param len Length of the buffer
+ * @param digest Where to store the digest, the two halves of the hash are
+ * 	  stored in network byte order
+ */
+
+void compute_digest(const void *data, size_t len, digest_t &digest)
+{
+	const uint8_t *p = static_cast<const uint8_t*> (data);
+	const uint8_t *tail = p + (len / 16) * 16;
+	const uint64_t c1 = 0x87c37b91114253d5ULL;
+	const uint64_t c2 = 0x4cf5ad432745937fULL;
+	uint64_t h1 = 0, h2 = 0, k1, k2;
+
+	for (; p < tail; p += 16) {
+		memcpy(&k1, p, sizeof(k1));
+		memcpy(&k2, p + 8, sizeof(k2));
+		k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+		h1 = rotl64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+		k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+		h2 = rotl64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+	}
+
+	/* The last bytes, mixing a zero key leaves the state unchanged */
+	k1 = 0;
+	k2 = 0;
+	for (size_t i = len & 15; i > 8; i--)
+		k2 ^= (uint64_t) tail[i - 1] << ((i - 9) * 8);
+	for (size_t i = (len & 15) < 8 ? len & 15 : 8; i > 0; i--)
+		k1 ^= (uint64_t) tail[i - 1] << ((i - 1) * 8);
+	k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+	k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+
+	h1 ^= len;
+	h2 ^= len;
+	h1 += h2;
+	h2 += h1;
+	h1 = fmix64(h1);
+	h2 = fmix64(h2);
+	h1 += h2;
+	h2 += h1;
+
+	for (uint8_t i = 0; i < 8; i++) {
+		digest.bytes[i] = (uint8_t) (h1 >> (56 - 8 * i));
+		digest.bytes[8 + i] = (uint8_t) (h2 >> (56 - 8 * i));
+	}
+}
 
 /**
  * @brief Copies the timestruct
@@ -250,6 +550,37 @@ int32_t time_cmp(struct timespec *t1, struct timespec *t2)
 	return 0;
 }
 
+/**
+ * @brief Computes the difference between two times
+ * @param t1 
+ * @param t2
+ * @return It returns t1 - t2 in nanoseconds
+ */
+
+int64_t time_diff_ns(struct timespec *t1, struct timespec *t2)
+{
+	return (int64_t)(t1->tv_sec - t2->tv_sec) * 1000000000 + 
+		(t1->tv_nsec - t2->tv_nsec);
+}
+
+/**
+ * @brief Computes the poll timeout needed to wake up at a deadline
+ * @param now Current time
+ * @param deadline Time at which the caller must wake up
+ * @return It returns the milliseconds until the deadline rounded up, so 
+ * 	   that the deadline is never anticipated, or 0 if it has passed
+ */
+
+int64_t time_to_deadline_ms(struct timespec *now, struct timespec *deadline)
+{
+	int64_t ns = time_diff_ns(deadline, now);
+
+	if (ns <= 0)
+		return 0;
+
+	return (ns + 999999) / 1000000;
+}
+
 /**
  * @brief It does a busy wait
  * @param ms amount of milliseconds of busy wait
@@ -265,47 +596,3 @@ void busy_wait(uint32_t ms)
 		clock_gettime(CLOCK_MONOTONIC, &now);
 	} while(time_cmp(&now, &t) < 0);
 }
-
-/**
- * @brief Writes a log row to an output stream (either the console or a file)
- * @param who String representing who is writing the log row
- * @param what Information to log
- */
-
-void write_log(std::string who, std::string what)
-{
-	tm *now_struct;
-	struct timespec now;
-	
-	clock_gettime(CLOCK_REALTIME, &now);
-	now_struct = localtime(&now.tv_sec);
-	
-#ifdef CONSOLE_LOG
-	
-	std::cout << now_struct->tm_year + ABS_YEAR << "-" << 
-	++now_struct->tm_mon <<
-	"-" << now_struct->tm_mday << "_" << now_struct->tm_hour << ":"
-	<< now_struct->tm_min << ":" << now_struct->tm_sec << "." << 
-	(int32_t)(now.tv_nsec / 1e6) << " " << who << " " << what <<
-	std::endl;
-#else
-	struct stat sb;
-
-	/* Check if the 'log/' directory already exists */
-	if (stat("log/", &sb) != 0 || !S_ISDIR(sb.st_mode)) {
-		mkdir("log/", 0777);
-	}
-	std::filebuf fb;
-	fb.open("log/" + who + ".txt", std::ios::out | std::ios::app);
-	std::ostream os(&fb);
-	
-	os << now_struct->tm_year + ABS_YEAR << "-" << 
-	++now_struct->tm_mon <<
-	"-" << now_struct->tm_mday << "_" << now_struct->tm_hour << ":"
-	<< now_struct->tm_min << ":" << now_struct->tm_sec << "." << 
-	(int32_t)(now.tv_nsec / 1e6) << " " << who << " " << what <<
-	std::endl;
-	
-	fb.close();
-#endif
-}
\ No newline at end of file
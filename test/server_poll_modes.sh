@@ -0,0 +1,45 @@
+#!/bin/bash
+
+# Compares the blocking poll of the servers with the busy poll: for each
+# mode it prints the CPU used by the 3 idle servers and the time taken by a
+# client to get 5 replies. In busy poll the copy i is pinned to the core
+# CPU + i.
+# Usage: server_poll_modes.sh [CPU]
+
+CPU=${1:-0}
+IDLE=5
+TICKS=$(getconf CLK_TCK)
+
+# Sum of the user and system ticks of the servers
+server_ticks() {
+	local total=0
+	for pid in $(pgrep -x RSF_server); do
+		total=$((total + $(awk '{print $14 + $15}' /proc/$pid/stat)))
+	done
+	echo $total
+}
+
+run_mode() {
+	rm -rf log/*
+	./RSF_start_broker &
+	./RSF_deployment_unit -s 0 -n 3 &
+	sleep 2
+
+	start=$(server_ticks)
+	sleep $IDLE
+	end=$(server_ticks)
+	echo "$1: idle servers $(( (end - start) * 100 / (TICKS * IDLE) ))% CPU"
+
+	start=$(date +%s%N)
+	./RSF_client -s 0 > /dev/null
+	end=$(date +%s%N)
+	echo "$1: 5 requests in $(( (end - start) / 1000000 )) ms"
+
+	kill -9 $(pgrep RSF)
+	sleep 1
+}
+
+unset RSF_BUSY_POLL_CPU
+run_mode "blocking poll"
+export RSF_BUSY_POLL_CPU=$CPU
+run_mode "busy poll on CPU $CPU"